@@ -0,0 +1,359 @@
+/***
+ * analytic_contrast.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nathanael
+ *
+ *  Alternative to the orthogonal sampling of Contrast (-a). Contrast puts
+ *  an orthogonal every segment_size along the footways and counts the
+ *  orthogonals hitting a sidewalk. Here the same is calculated directly
+ *  from pairs of footway and sidewalk segments: the part of the footway
+ *  segment, where an orthogonal would hit the sidewalk segment, is an
+ *  interval. The length of these intervals replaces the number of
+ *  orthogonals, so no orthogonal is stored.
+ *
+ *  A sidewalk is detected if the covered length compared to its length is
+ *  higher than the contrast factor. It is erased if it is also the closest
+ *  sidewalk on this share of the footways.
+ *
+ */
+
+#ifndef ANALYTIC_CONTRAST_HPP_
+#define ANALYTIC_CONTRAST_HPP_
+
+class AnalyticContrast {
+
+    /***
+     * Segment of a sidewalk in the segment index.
+     */
+    struct SidewalkSegment {
+        Sidewalk* sidewalk;
+        Coordinate start;
+        Coordinate end;
+    };
+
+    /***
+     * Part [t_start, t_end] of a footway segment (km from its start), where
+     * an orthogonal hits a sidewalk segment. d_start and d_end are the
+     * signed distances along the orthogonal at both ends.
+     */
+    struct Cover {
+        Sidewalk* sidewalk;
+        double t_start;
+        double t_end;
+        double d_start;
+        double d_end;
+
+        double slope() const {
+            return (d_end - d_start) / (t_end - t_start);
+        }
+
+        double distance(double t) const {
+            return d_start + (t - t_start) * slope();
+        }
+
+        bool operator<(const Cover& other) const {
+            if (sidewalk != other.sidewalk) {
+                return sidewalk < other.sidewalk;
+            }
+            return t_start < other.t_start;
+        }
+    };
+
+    DataStorage& ds;
+    GeomOperate go;
+    vector<SidewalkSegment> segments;
+    PackedRTree<uint32_t> segment_index;
+    google::sparse_hash_map<Sidewalk*, double> covered_length;
+    google::sparse_hash_map<Sidewalk*, double> closest_length;
+
+    //PARAMETERS, see parameters.hpp
+    const double ortho_length = Parameters::get().ortho_length;
+    const double contrast_factor = Parameters::get().contrast_factor;
+    const double orientation_tolerance =
+            Parameters::get().orientation_tolerance;
+    const double min_length = Parameters::get().min_length;
+    const double distance_tolerance = 0.00005; // ca. 5cm, sidewalks as close
+                                               // as the closest one
+    const double max_sin_squared;            // squared sine of
+                                             // orientation_tolerance
+
+    void fill_segment_index() {
+        for (auto map_entry : ds.sidewalk_map) {
+            Sidewalk* sidewalk = map_entry.second;
+            const CoordinateSequence* coords = dynamic_cast<LineString*>(
+                    sidewalk->geometry)->getCoordinatesRO();
+            for (size_t i = 0; i + 1 < coords->getSize(); ++i) {
+                SidewalkSegment segment = {sidewalk, coords->getAt(i),
+                        coords->getAt(i + 1)};
+                segment_index.add(segments.size(),
+                        Envelope(segment.start, segment.end));
+                segments.push_back(segment);
+            }
+        }
+        segment_index.finish();
+    }
+
+    /***
+     * Interval of the footway segment, where an orthogonal hits the sidewalk
+     * segment. The footway segment starts at the origin with the unit
+     * direction (ux, uy) and the given length, p and q are the ends of the
+     * sidewalk segment in the same local plane (km).
+     * Returns false, if there is none or the orientation is not similar.
+     */
+    bool get_cover(double ux, double uy, double length, double px,
+            double py, double qx, double qy, Cover& cover) {
+
+        double sx = qx - px;
+        double sy = qy - py;
+        double cross = ux * sy - uy * sx;
+        if (cross * cross >= max_sin_squared * (sx * sx + sy * sy)) {
+            return false;
+        }
+        double t_p = ux * px + uy * py;
+        double t_q = ux * qx + uy * qy;
+        double d_p = ux * py - uy * px;
+        double d_q = ux * qy - uy * qx;
+        if (t_p > t_q) {
+            swap(t_p, t_q);
+            swap(d_p, d_q);
+        }
+        if (t_q <= t_p) {
+            return false;
+        }
+        double slope = (d_q - d_p) / (t_q - t_p);
+        double t_start = max(t_p, 0.0);
+        double t_end = min(t_q, length);
+        if (slope != 0) {
+            double t_low = t_p + (-ortho_length - d_p) / slope;
+            double t_high = t_p + (ortho_length - d_p) / slope;
+            if (t_low > t_high) {
+                swap(t_low, t_high);
+            }
+            t_start = max(t_start, t_low);
+            t_end = min(t_end, t_high);
+        } else if (abs(d_p) > ortho_length) {
+            return false;
+        }
+        if (t_start >= t_end) {
+            return false;
+        }
+        cover.t_start = t_start;
+        cover.t_end = t_end;
+        cover.d_start = d_p + (t_start - t_p) * slope;
+        cover.d_end = d_p + (t_end - t_p) * slope;
+        return true;
+    }
+
+    /***
+     * Add the length of the union of the covers of each sidewalk. The covers
+     * are sorted by sidewalk and start.
+     */
+    void add_covered_length(const vector<Cover>& covers) {
+        size_t i = 0;
+        while (i < covers.size()) {
+            Sidewalk* sidewalk = covers[i].sidewalk;
+            double union_length = 0;
+            double t_start = covers[i].t_start;
+            double t_end = covers[i].t_end;
+            for (; (i < covers.size()) && (covers[i].sidewalk == sidewalk);
+                    ++i) {
+                if (covers[i].t_start > t_end) {
+                    union_length += t_end - t_start;
+                    t_start = covers[i].t_start;
+                }
+                t_end = max(t_end, covers[i].t_end);
+            }
+            union_length += t_end - t_start;
+            covered_length[sidewalk] += union_length;
+        }
+    }
+
+    /***
+     * Add the length where a sidewalk is the closest one. The absolute
+     * distances are piecewise linear, so between the ends of the covers,
+     * the zero crossings and the crossings of two distances the closest
+     * sidewalk does not change. Sorted by start, only overlapping covers are
+     * compared and each piece between two breaks only looks at the covers
+     * active there.
+     */
+    void add_closest_length(const vector<Cover>& covers) {
+        vector<const Cover*> by_start;
+        by_start.reserve(covers.size());
+        for (const Cover& cover : covers) {
+            by_start.push_back(&cover);
+        }
+        sort(by_start.begin(), by_start.end(),
+                [](const Cover* a, const Cover* b) {
+            return a->t_start < b->t_start;
+        });
+        vector<double> breaks;
+        for (size_t i = 0; i < by_start.size(); ++i) {
+            const Cover& cover = *by_start[i];
+            breaks.push_back(cover.t_start);
+            breaks.push_back(cover.t_end);
+            if (cover.d_start * cover.d_end < 0) {
+                breaks.push_back(cover.t_start - cover.d_start /
+                        cover.slope());
+            }
+            for (size_t j = i + 1; (j < by_start.size()) &&
+                    (by_start[j]->t_start < cover.t_end); ++j) {
+                const Cover& other = *by_start[j];
+                double t_start = other.t_start;
+                double t_end = min(cover.t_end, other.t_end);
+                if (t_start >= t_end) {
+                    continue;
+                }
+                double d1 = cover.distance(t_start);
+                double d2 = other.distance(t_start);
+                double difference = cover.slope() - other.slope();
+                double sum = cover.slope() + other.slope();
+                if (difference != 0) {
+                    double t = t_start + (d2 - d1) / difference;
+                    if ((t > t_start) && (t < t_end)) {
+                        breaks.push_back(t);
+                    }
+                }
+                if (sum != 0) {
+                    double t = t_start - (d1 + d2) / sum;
+                    if ((t > t_start) && (t < t_end)) {
+                        breaks.push_back(t);
+                    }
+                }
+            }
+        }
+        sort(breaks.begin(), breaks.end());
+        vector<const Cover*> active;
+        size_t next = 0;
+        vector<Sidewalk*> closest;
+        for (size_t k = 0; k + 1 < breaks.size(); ++k) {
+            double t_start = breaks[k];
+            double t_end = breaks[k + 1];
+            if (t_start >= t_end) {
+                continue;
+            }
+            double t = (t_start + t_end) / 2;
+            while ((next < by_start.size()) &&
+                    (by_start[next]->t_start <= t)) {
+                active.push_back(by_start[next++]);
+            }
+            active.erase(remove_if(active.begin(), active.end(),
+                    [t](const Cover* cover) {
+                return cover->t_end < t;
+            }), active.end());
+            double min_distance = -1;
+            for (const Cover* cover : active) {
+                double distance = abs(cover->distance(t));
+                if ((min_distance < 0) || (distance < min_distance)) {
+                    min_distance = distance;
+                }
+            }
+            if (min_distance < 0) {
+                continue;
+            }
+            closest.clear();
+            for (const Cover* cover : active) {
+                if (abs(cover->distance(t)) - min_distance <
+                        distance_tolerance) {
+                    closest.push_back(cover->sidewalk);
+                }
+            }
+            sort(closest.begin(), closest.end());
+            closest.erase(unique(closest.begin(), closest.end()),
+                    closest.end());
+            for (Sidewalk* sidewalk : closest) {
+                closest_length[sidewalk] += t_end - t_start;
+            }
+        }
+    }
+
+    /***
+     * Find the covers of one footway segment with all sidewalk segments of
+     * the segment index within the orthogonal length. The calculations are
+     * done in a local plane (km) at the start of the footway segment.
+     */
+    void check_footway_segment(const Coordinate& start, const Coordinate& end,
+            vector<Cover>& covers) {
+
+        LocalPlane& plane = LocalPlane::get();
+        double km_per_lat = plane.km_per_lat;
+        double km_per_lon = plane.is_active() ? plane.km_per_lon(start.y) :
+                km_per_lat * cos(start.y * TO_RAD);
+        double fx = (end.x - start.x) * km_per_lon;
+        double fy = (end.y - start.y) * km_per_lat;
+        double length = sqrt(fx * fx + fy * fy);
+        if (length == 0) {
+            return;
+        }
+        double ux = fx / length;
+        double uy = fy / length;
+        Envelope envelope(start, end);
+        envelope.expandBy(ortho_length / km_per_lon,
+                ortho_length / km_per_lat);
+        covers.clear();
+        segment_index.query(envelope, [&](uint32_t position) {
+            const SidewalkSegment& segment = segments[position];
+            Cover cover;
+            cover.sidewalk = segment.sidewalk;
+            if (get_cover(ux, uy, length,
+                    (segment.start.x - start.x) * km_per_lon,
+                    (segment.start.y - start.y) * km_per_lat,
+                    (segment.end.x - start.x) * km_per_lon,
+                    (segment.end.y - start.y) * km_per_lat, cover)) {
+                covers.push_back(cover);
+            }
+        });
+        if (covers.empty()) {
+            return;
+        }
+        sort(covers.begin(), covers.end());
+        add_covered_length(covers);
+        add_closest_length(covers);
+    }
+
+public:
+
+    explicit AnalyticContrast(DataStorage& data_storage) :
+            ds(data_storage),
+            max_sin_squared(pow(sin(orientation_tolerance * TO_RAD), 2)) {
+    }
+
+    /***
+     * Run the analytic constrast. All footway segments longer than
+     * min_length are compared with the sidewalk segments. Detected
+     * sidewalks are written to the intersects layer, the closest ones are
+     * erased.
+     */
+    void check_sidewalks() {
+        fill_segment_index();
+        vector<double> lengths;
+        vector<Cover> covers;
+        for (PedestrianRoad* pedestrian : ds.pedestrian_road_set) {
+            const CoordinateSequence* coords = dynamic_cast<LineString*>(
+                    pedestrian->geometry)->getCoordinatesRO();
+            go.segment_lengths(coords, lengths);
+            for (size_t i = 0; i < lengths.size(); ++i) {
+                if (lengths[i] < min_length) {
+                    continue;
+                }
+                check_footway_segment(coords->getAt(i), coords->getAt(i + 1),
+                        covers);
+            }
+        }
+        for (auto entry : covered_length) {
+            Sidewalk* sidewalk = entry.first;
+            if (entry.second / sidewalk->length <= contrast_factor) {
+                continue;
+            }
+            auto closest = closest_length.find(sidewalk);
+            if ((closest != closest_length.end()) &&
+                    (closest->second / sidewalk->length > contrast_factor)) {
+                ds.sidewalk_map.erase(sidewalk->id);
+            }
+            ds.store_intersect(sidewalk->geometry, sidewalk->length,
+                    entry.second / sidewalk->length);
+        }
+    }
+};
+
+#endif /* ANALYTIC_CONTRAST_HPP_ */
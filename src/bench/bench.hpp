@@ -0,0 +1,59 @@
+/***
+ * bench.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nathanael
+ *
+ *  Common includes of the benchmarks and checks in bench/. They include
+ *  the headers of pedro the same way main.cpp does. Build them with
+ *  "make bench", "make check" runs the checks.
+ *
+ */
+
+#ifndef BENCH_HPP_
+#define BENCH_HPP_
+
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <osmium/index/map/sparse_mem_array.hpp>
+#include <osmium/handler/node_locations_for_ways.hpp>
+#include <osmium/osm/location.hpp>
+#include <osmium/geom/ogr.hpp>
+#include <osmium/geom/geos.hpp>
+#include <geos/algorithm/CGAlgorithmsDD.h>
+#include <geos/geom/Coordinate.h>
+#include <geos/geom/CoordinateArraySequence.h>
+#include <geos/geom/GeometryFactory.h>
+#include <geos/geom/LineSegment.h>
+#include <geos/io/WKBWriter.h>
+#include <geos/io/WKBReader.h>
+#include <google/sparse_hash_set>
+#include <google/sparse_hash_map>
+
+using namespace std;
+using namespace osmium;
+using namespace geos::geom;
+
+#include "../timer.h"
+#include "../simd_double.hpp"
+#include "../geom_operate.hpp"
+
+/***
+ * Random locations in a box of about 20 x 20 km around Stuttgart, with
+ * the 7 decimals of OSM.
+ */
+inline vector<Location> random_locations(size_t count, unsigned seed = 1) {
+    mt19937 generator(seed);
+    uniform_int_distribution<int32_t> lon(91000000, 93800000);
+    uniform_int_distribution<int32_t> lat(486800000, 488600000);
+    vector<Location> locations;
+    locations.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        locations.push_back(Location(lon(generator), lat(generator)));
+    }
+    return locations;
+}
+
+#endif /* BENCH_HPP_ */
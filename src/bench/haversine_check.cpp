@@ -0,0 +1,98 @@
+/***
+ * haversine_check.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nathanael
+ *
+ *  Accuracy check and benchmark of GeomOperate::haversine_batch against
+ *  haversine for each segment, with and without the local plane. Lines
+ *  of short segments with some long jumps cover the SIMD kernel and its
+ *  scalar fallback. Fails if a segment differs by more than 1e-9 km.
+ *  Build it with -DPEDRO_NO_SIMD to check the scalar loops only.
+ *
+ *      bench/haversine_check [NUM_LINES]
+ *
+ */
+
+#include "bench.hpp"
+
+double max_batch_error(GeomOperate& go, size_t num_lines) {
+    mt19937 generator(1);
+    uniform_real_distribution<double> step(-0.002, 0.002);
+    uniform_real_distribution<double> jump(-1, 1);
+    vector<Location> starts = random_locations(num_lines);
+    double max_error = 0;
+    for (size_t line = 0; line < num_lines; ++line) {
+        size_t n = 2 + line % 37;
+        vector<double> lon(n);
+        vector<double> lat(n);
+        vector<double> distances(n - 1);
+        lon[0] = starts[line].lon();
+        lat[0] = starts[line].lat();
+        for (size_t i = 1; i < n; ++i) {
+            bool is_jump = (line % 11 == 0) && (i % 3 == 0);
+            lon[i] = lon[i - 1] + (is_jump ? jump(generator) : step(generator));
+            lat[i] = lat[i - 1] + (is_jump ? jump(generator) : step(generator));
+        }
+        go.haversine_batch(lon.data(), lat.data(), n, distances.data());
+        for (size_t i = 0; i + 1 < n; ++i) {
+            double error = abs(distances[i] - go.haversine(lon[i], lat[i],
+                    lon[i + 1], lat[i + 1]));
+            max_error = max(max_error, error);
+        }
+    }
+    return max_error;
+}
+
+int main(int argc, char* argv[]) {
+    size_t num_lines = (argc > 1) ? atol(argv[1]) : 100000;
+    GeomOperate go;
+    LocalPlane& plane = LocalPlane::get();
+
+    plane.enabled = false;
+    double sphere_error = max_batch_error(go, num_lines);
+    plane.enabled = true;
+    double plane_error = max_batch_error(go, num_lines);
+    plane.enabled = false;
+
+    vector<Location> locations = random_locations(1000);
+    vector<double> lon;
+    vector<double> lat;
+    for (Location location : locations) {
+        lon.push_back(location.lon());
+        lat.push_back(location.lat());
+    }
+    vector<double> distances(lon.size() - 1);
+    double sum = 0;
+    timer batch_timer;
+    batch_timer.start();
+    for (size_t j = 0; j < num_lines / 10; ++j) {
+        go.haversine_batch(lon.data(), lat.data(), lon.size(),
+                distances.data());
+        sum += distances[j % distances.size()];
+    }
+    batch_timer.stop();
+    timer scalar_timer;
+    scalar_timer.start();
+    for (size_t j = 0; j < num_lines / 10; ++j) {
+        for (size_t i = 0; i + 1 < lon.size(); ++i) {
+            distances[i] = go.haversine(lon[i], lat[i], lon[i + 1],
+                    lat[i + 1]);
+        }
+        sum += distances[j % distances.size()];
+    }
+    scalar_timer.stop();
+
+    cout << "SIMD width " << SIMD_DOUBLE_WIDTH << endl;
+    cout << "  haversine_batch: " << batch_timer << endl;
+    cout << "  haversine:       " << scalar_timer << endl;
+    cout.unsetf(ios::floatfield);
+    cout << setprecision(3) << "  (checksum " << sum << ")" << endl;
+    cout << "  max error sphere: " << sphere_error << " km" << endl;
+    cout << "  max error plane:  " << plane_error << " km" << endl;
+    if ((sphere_error > 1e-9) || (plane_error > 1e-9)) {
+        cerr << "haversine_batch differs from haversine" << endl;
+        return 1;
+    }
+    return 0;
+}
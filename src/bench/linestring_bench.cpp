@@ -0,0 +1,149 @@
+/***
+ * linestring_bench.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nathanael
+ *
+ *  Before/after comparison of the offset lines of the sidewalk generation
+ *  (GeomOperate::parallel_line on both sides of each road segment). The
+ *  former version formatted the two offset locations as WKT and parsed the
+ *  text with the WKTReader, the current one fills the coordinate sequence
+ *  directly. The road segments are the pairs of consecutive nodes of the
+ *  highways of an OSM file, without a file random ones are used. Prints
+ *  the time of both and the largest coordinate difference.
+ *
+ *      bench/linestring_bench [OSMFILE]
+ *
+ */
+
+#include <osmium/io/any_input.hpp>
+#include <osmium/visitor.hpp>
+#include <geos/io/WKTReader.h>
+#include "bench.hpp"
+
+typedef index::map::SparseMemArray<unsigned_object_id_type,
+        Location> index_type;
+typedef handler::NodeLocationsForWays<index_type> location_handler_type;
+
+const double SIDEWALK_OFFSET = 0.0045;  // default of Parameters
+
+/***
+ * Pairs of consecutive node locations of all ways with a highway tag.
+ */
+class SegmentHandler : public handler::Handler {
+
+public:
+
+    vector<pair<Location, Location>> segments;
+
+    void way(const Way& way) {
+        if (!way.tags().get_value_by_key("highway")) {
+            return;
+        }
+        const WayNodeList& nodes = way.nodes();
+        for (size_t i = 0; i + 1 < nodes.size(); ++i) {
+            if (nodes[i].location().valid() &&
+                    nodes[i + 1].location().valid()) {
+                segments.push_back(pair<Location, Location>(
+                        nodes[i].location(), nodes[i + 1].location()));
+            }
+        }
+    }
+};
+
+/***
+ * parallel_line with the former WKT construction: the offset locations
+ * are written with to_string (6 decimals) and parsed by the WKTReader.
+ */
+LineString* parallel_line_wkt(GeomOperate& go, geos::io::WKTReader& reader,
+        Location location1, Location location2, bool left) {
+
+    Location start = go.vertical_location(location1, location2,
+            SIDEWALK_OFFSET, left);
+    Location end = go.vertical_location(location2, location1,
+            SIDEWALK_OFFSET, !left);
+    string target_wkt = "LINESTRING (";
+    target_wkt += to_string(start.lon()) + " ";
+    target_wkt += to_string(start.lat()) + ", ";
+    target_wkt += to_string(end.lon()) + " ";
+    target_wkt += to_string(end.lat()) + ")";
+    Geometry* geos_line = reader.read(target_wkt);
+    if (!geos_line) {
+        cerr << "Failed to create from wkt.";
+        exit(1);
+    }
+    return dynamic_cast<LineString*>(geos_line);
+}
+
+double max_difference(const LineString* line1, const LineString* line2) {
+    double difference = 0;
+    for (size_t i = 0; i < 2; ++i) {
+        difference = max(difference, max(
+                abs(line1->getCoordinateN(i).x - line2->getCoordinateN(i).x),
+                abs(line1->getCoordinateN(i).y - line2->getCoordinateN(i).y)));
+    }
+    return difference;
+}
+
+int main(int argc, char* argv[]) {
+    vector<pair<Location, Location>> segments;
+    if (argc > 1) {
+        index_type index;
+        location_handler_type location_handler(index);
+        SegmentHandler segment_handler;
+        io::Reader reader(argv[1]);
+        apply(reader, location_handler, segment_handler);
+        reader.close();
+        segments.swap(segment_handler.segments);
+    } else {
+        vector<Location> locations = random_locations(1000001);
+        for (size_t i = 0; i + 1 < locations.size(); ++i) {
+            segments.push_back(pair<Location, Location>(locations[i],
+                    locations[i + 1]));
+        }
+    }
+    GeomOperate go;
+    GeometryFactory factory;
+    geos::io::WKTReader reader(factory);
+    vector<LineString*> wkt_lines;
+    vector<LineString*> direct_lines;
+    wkt_lines.reserve(2 * segments.size());
+    direct_lines.reserve(2 * segments.size());
+
+    timer wkt_timer;
+    wkt_timer.start();
+    for (auto& segment : segments) {
+        for (bool left : {true, false}) {
+            wkt_lines.push_back(parallel_line_wkt(go, reader, segment.first,
+                    segment.second, left));
+        }
+    }
+    wkt_timer.stop();
+
+    timer direct_timer;
+    direct_timer.start();
+    for (auto& segment : segments) {
+        for (bool left : {true, false}) {
+            direct_lines.push_back(go.parallel_line(segment.first,
+                    segment.second, SIDEWALK_OFFSET, left));
+        }
+    }
+    direct_timer.stop();
+
+    double difference = 0;
+    for (size_t i = 0; i < wkt_lines.size(); ++i) {
+        difference = max(difference, max_difference(wkt_lines[i],
+                direct_lines[i]));
+        factory.destroyGeometry(wkt_lines[i]);
+        factory.destroyGeometry(direct_lines[i]);
+    }
+
+    cout << segments.size() << " road segments, " << wkt_lines.size()
+            << " offset lines" << endl;
+    cout << "  wkt:    " << wkt_timer << endl;
+    cout << "  direct: " << direct_timer << endl;
+    cout.unsetf(ios::floatfield);
+    cout << setprecision(3);
+    cout << "  max difference: " << difference << " degree" << endl;
+    return 0;
+}
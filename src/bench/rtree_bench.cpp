@@ -0,0 +1,115 @@
+/***
+ * rtree_bench.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nathanael
+ *
+ *  Build and query time of the PackedRTree against the STRtree of GEOS,
+ *  for random boxes of about the size of the orthogonals and queries of
+ *  about the size of sidewalk envelopes. Both have to find the same
+ *  number of candidates. The PackedRTree is also queried after it was
+ *  saved and mapped into memory again.
+ *
+ *      bench/rtree_bench [COUNT]
+ *
+ */
+
+#include <geos/index/strtree/STRtree.h>
+
+#include "bench.hpp"
+#include "../packed_rtree.hpp"
+
+/***
+ * Random envelopes in the box of random_locations, up to max_size
+ * degrees wide and high.
+ */
+vector<Envelope> random_envelopes(size_t count, double max_size,
+        unsigned seed) {
+
+    mt19937 generator(seed);
+    uniform_real_distribution<double> size(0, max_size);
+    vector<Location> locations = random_locations(count, seed);
+    vector<Envelope> envelopes;
+    envelopes.reserve(count);
+    for (const Location& location : locations) {
+        double x = location.lon();
+        double y = location.lat();
+        envelopes.push_back(Envelope(x, x + size(generator), y,
+                y + size(generator)));
+    }
+    return envelopes;
+}
+
+int main(int argc, char* argv[]) {
+    size_t count = (argc > 1) ? atol(argv[1]) : 500000;
+    vector<Envelope> items = random_envelopes(count, 0.0003, 1);
+    vector<Envelope> queries = random_envelopes(count / 10, 0.003, 2);
+    cout << count << " boxes, " << queries.size() << " queries" << endl;
+
+    timer packed_build;
+    packed_build.start();
+    PackedRTree<size_t> packed;
+    for (size_t i = 0; i < items.size(); ++i) {
+        packed.add(i, items[i]);
+    }
+    packed.finish();
+    packed_build.stop();
+    timer packed_query;
+    packed_query.start();
+    size_t packed_hits = 0;
+    for (const Envelope& query : queries) {
+        packed.query(query, [&](size_t) {
+            packed_hits++;
+        });
+    }
+    packed_query.stop();
+
+    string index_path = "rtree_bench.idx";
+    packed.save(index_path);
+    PackedRTree<size_t> mapped;
+    mapped.load(index_path);
+    timer mapped_query;
+    mapped_query.start();
+    size_t mapped_hits = 0;
+    for (const Envelope& query : queries) {
+        mapped.query(query, [&](size_t) {
+            mapped_hits++;
+        });
+    }
+    mapped_query.stop();
+    mapped.clear();
+    remove(index_path.c_str());
+
+    timer strtree_build;
+    strtree_build.start();
+    geos::index::strtree::STRtree strtree;
+    for (size_t i = 0; i < items.size(); ++i) {
+        strtree.insert(&items[i], reinterpret_cast<void*>(i));
+    }
+    strtree.build();
+    strtree_build.stop();
+    timer strtree_query;
+    strtree_query.start();
+    size_t strtree_hits = 0;
+    vector<void*> results;
+    for (const Envelope& query : queries) {
+        results.clear();
+        strtree.query(&query, results);
+        strtree_hits += results.size();
+    }
+    strtree_query.stop();
+
+    cout << "  PackedRTree build: " << packed_build << ", query: "
+            << packed_query << ", " << packed_hits << " candidates" << endl;
+    cout << "  mapped      query: " << mapped_query << ", " << mapped_hits
+            << " candidates" << endl;
+    cout << "  STRtree     build: " << strtree_build << ", query: "
+            << strtree_query << ", " << strtree_hits << " candidates"
+            << endl;
+    if ((packed_hits != strtree_hits) || (packed_hits != mapped_hits)) {
+        cerr << "PackedRTree, mapped tree and STRtree found different "
+                << "candidates" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,100 @@
+/***
+ * spatial_join_check.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nathanael
+ *
+ *  Compares SpatialJoin with a brute force join of all envelope pairs, for
+ *  random boxes of different sizes (and some null and degenerate ones)
+ *  with 1 and 4 threads. Prints the time of both and fails on the first
+ *  difference.
+ *
+ *      bench/spatial_join_check [COUNT]
+ *
+ */
+
+#include "bench.hpp"
+#include "../packed_rtree.hpp"
+#include "../spatial_join.hpp"
+
+/***
+ * Random envelopes in the box of random_locations, a few meters up to
+ * about one kilometer wide. Every 97th one is null, every 13th a point.
+ */
+vector<Envelope> random_envelopes(size_t count, unsigned seed) {
+    mt19937 generator(seed);
+    uniform_real_distribution<double> size(0.00005, 0.01);
+    vector<Location> locations = random_locations(count, seed);
+    vector<Envelope> envelopes;
+    envelopes.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        double x = locations[i].lon();
+        double y = locations[i].lat();
+        if (i % 97 == 0) {
+            envelopes.push_back(Envelope());
+        } else if (i % 13 == 0) {
+            envelopes.push_back(Envelope(x, x, y, y));
+        } else {
+            envelopes.push_back(Envelope(x, x + size(generator), y,
+                    y + size(generator)));
+        }
+    }
+    return envelopes;
+}
+
+vector<const Envelope*> pointers(const vector<Envelope>& envelopes) {
+    vector<const Envelope*> result;
+    for (const Envelope& envelope : envelopes) {
+        result.push_back(&envelope);
+    }
+    return result;
+}
+
+void brute_force_join(const vector<const Envelope*>& left,
+        const vector<const Envelope*>& right,
+        vector<join_pair_type>& pairs) {
+
+    pairs.clear();
+    for (size_t i = 0; i < left.size(); ++i) {
+        for (size_t j = 0; j < right.size(); ++j) {
+            if (!left[i]->isNull() && !right[j]->isNull() &&
+                    left[i]->intersects(right[j])) {
+                pairs.push_back(join_pair_type(i, j));
+            }
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t count = (argc > 1) ? atol(argv[1]) : 20000;
+    vector<Envelope> left_envelopes = random_envelopes(count, 1);
+    vector<Envelope> right_envelopes = random_envelopes(count / 2, 2);
+    vector<const Envelope*> left = pointers(left_envelopes);
+    vector<const Envelope*> right = pointers(right_envelopes);
+
+    vector<join_pair_type> expected;
+    timer brute_force_timer;
+    brute_force_timer.start();
+    brute_force_join(left, right, expected);
+    brute_force_timer.stop();
+    cout << count << " x " << count / 2 << " envelopes, "
+            << expected.size() << " pairs" << endl;
+    cout << "  brute force: " << brute_force_timer << endl;
+
+    for (unsigned int num_threads : {1u, 4u}) {
+        vector<join_pair_type> pairs;
+        timer join_timer;
+        join_timer.start();
+        SpatialJoin spatial_join(num_threads);
+        spatial_join.join(left, right, pairs);
+        join_timer.stop();
+        cout << "  join, " << num_threads << " thread(s): " << join_timer
+                << endl;
+        if (pairs != expected) {
+            cerr << "SpatialJoin with " << num_threads << " thread(s) "
+                    << "differs from the brute force join" << endl;
+            return 1;
+        }
+    }
+    return 0;
+}
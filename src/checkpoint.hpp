@@ -0,0 +1,447 @@
+/***
+ * checkpoint.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nathanael
+ *
+ *  The Checkpoint writes the DataStorage into a compact binary file after
+ *  each stage of the pipeline. With --resume-from the file is mapped into
+ *  memory and the DataStorage is restored, so only the later stages have to
+ *  run again.
+ *
+ *  File layout (all numbers in host byte order):
+ *    magic, stage name
+ *    vehicle roads, pedestrian roads, sidewalks, crossings, crossing pairs,
+ *    intersects (coordinates, length and ratio), orthogonals (start, end,
+ *    distance)
+ *    crossing_node_map, vehicle_node_map, node locations
+ *  The packed R-tree of the orthogonals is written next to it by
+ *  PackedRTree::save and mapped again on load.
+ *
+ */
+
+#ifndef CHECKPOINT_HPP_
+#define CHECKPOINT_HPP_
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class Checkpoint {
+
+    DataStorage& ds;
+    index_pos_type& location_index;
+    location_handler_type& location_handler;
+    GeometryFactory geos_factory;
+    const char* MAGIC = "PEDROCK6";
+
+    FILE* out;
+    const char* in_position;
+    const char* in_end;
+
+    /*** writing ***/
+
+    void write_raw(const void* data, size_t size) {
+        if (fwrite(data, 1, size, out) != size) {
+            cerr << "Failed to write checkpoint." << endl;
+            exit(1);
+        }
+    }
+
+    template <typename T>
+    void write(T value) {
+        write_raw(&value, sizeof(T));
+    }
+
+    void write(const string& value) {
+        write<uint32_t>(value.size());
+        write_raw(value.data(), value.size());
+    }
+
+    void write(Geometry* geometry) {
+        CoordinateSequence* coords = geometry->getCoordinates();
+        write<uint32_t>(coords->getSize());
+        for (size_t i = 0; i < coords->getSize(); ++i) {
+            const Coordinate& coord = coords->getAt(i);
+            write<double>(coord.x);
+            write<double>(coord.y);
+        }
+        delete coords;
+    }
+
+    /***
+     * Base members of every PedroRoad.
+     */
+    void write_road(PedroRoad* road) {
+        write(road->id);
+        write(road->name);
+        write(road->type);
+        write<double>(road->length);
+        write(road->geometry);
+    }
+
+    /*** reading ***/
+
+    void read_raw(void* data, size_t size) {
+        if (in_position + size > in_end) {
+            cerr << "Checkpoint is truncated." << endl;
+            exit(1);
+        }
+        memcpy(data, in_position, size);
+        in_position += size;
+    }
+
+    template <typename T>
+    T read() {
+        T value;
+        read_raw(&value, sizeof(T));
+        return value;
+    }
+
+    string read_string() {
+        uint32_t size = read<uint32_t>();
+        if (in_position + size > in_end) {
+            cerr << "Checkpoint is truncated." << endl;
+            exit(1);
+        }
+        string value(in_position, size);
+        in_position += size;
+        return value;
+    }
+
+    Coordinate read_coordinate() {
+        double x = read<double>();
+        return Coordinate(x, read<double>());
+    }
+
+    Geometry* read_geometry() {
+        uint32_t size = read<uint32_t>();
+        vector<Coordinate>* coord_v = new vector<Coordinate>();
+        coord_v->reserve(size);
+        for (uint32_t i = 0; i < size; ++i) {
+            double x = read<double>();
+            double y = read<double>();
+            coord_v->push_back(Coordinate(x, y));
+        }
+        CoordinateSequence* coords = new CoordinateArraySequence(coord_v);
+        return geos_factory.createLineString(coords);
+    }
+
+    void read_road(PedroRoad* road) {
+        road->id = read_string();
+        road->name = read_string();
+        road->type = read_string();
+        road->length = read<double>();
+        road->geometry = read_geometry();
+    }
+
+    void restore(google::sparse_hash_map<uint32_t, VehicleRoad*>&
+            vehicle_roads, bool with_locations) {
+
+        uint32_t count = read<uint32_t>();
+        for (uint32_t i = 0; i < count; ++i) {
+            VehicleRoad* road = new VehicleRoad();
+            read_road(road);
+            road->osm_id = read_string();
+            road->lanes = read<int32_t>();
+            road->sidewalk = read<char>();
+            vehicle_roads[i] = road;
+            ds.vehicle_road_set.insert(road);
+        }
+        count = read<uint32_t>();
+        for (uint32_t i = 0; i < count; ++i) {
+            PedestrianRoad* road = new PedestrianRoad();
+            read_road(road);
+            road->osm_id = read_string();
+            ds.pedestrian_road_set.insert(road);
+        }
+        count = read<uint32_t>();
+        for (uint32_t i = 0; i < count; ++i) {
+            Sidewalk* sidewalk = new Sidewalk();
+            read_road(sidewalk);
+            sidewalk->osm_id = read_string();
+            sidewalk->at_osm_type = read_string();
+            ds.sidewalk_map[sidewalk->id] = sidewalk;
+        }
+        count = read<uint32_t>();
+        for (uint32_t i = 0; i < count; ++i) {
+            Crossing* crossing = new Crossing();
+            read_road(crossing);
+            crossing->osm_type = read_string();
+            ds.crossing_set.insert(crossing);
+        }
+        count = read<uint32_t>();
+        for (uint32_t i = 0; i < count; ++i) {
+            CrossingPair* crossing_pair = new CrossingPair();
+            crossing_pair->sidewalk_id = read_string();
+            crossing_pair->neighbour_id = read_string();
+            crossing_pair->sidewalk_point.x = read<double>();
+            crossing_pair->sidewalk_point.y = read<double>();
+            crossing_pair->neighbour_point.x = read<double>();
+            crossing_pair->neighbour_point.y = read<double>();
+            crossing_pair->type = read_string();
+            ds.crossing_pairs.push_back(crossing_pair);
+        }
+        count = read<uint32_t>();
+        ds.intersects.resize(count);
+        for (Intersect& intersect : ds.intersects) {
+            uint32_t num_coords = read<uint32_t>();
+            intersect.coords.reserve(num_coords);
+            for (uint32_t j = 0; j < num_coords; ++j) {
+                intersect.coords.push_back(read_coordinate());
+            }
+            intersect.length = read<double>();
+            intersect.ratio = read<double>();
+        }
+        count = read<uint32_t>();
+        ds.orthos.reserve(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            Coordinate start = read_coordinate();
+            Coordinate end = read_coordinate();
+            vector<Coordinate>* coord_v = new vector<Coordinate>();
+            coord_v->push_back(start);
+            coord_v->push_back(end);
+            LineString* line = geos_factory.createLineString(
+                    new CoordinateArraySequence(coord_v));
+            ds.orthos.push_back(new Orthogonal(line, start, end,
+                    read<double>()));
+        }
+        count = read<uint32_t>();
+        for (uint32_t i = 0; i < count; ++i) {
+            object_id_type node_id = read<object_id_type>();
+            ds.crossing_node_map[node_id] = new CrossingPoint(read_string());
+        }
+        count = read<uint32_t>();
+        for (uint32_t i = 0; i < count; ++i) {
+            object_id_type node_id = read<object_id_type>();
+            uint32_t num_values = read<uint32_t>();
+            vector<VehicleMapValue>& values = ds.vehicle_node_map[node_id];
+            for (uint32_t j = 0; j < num_values; ++j) {
+                object_id_type neighbour_id = read<object_id_type>();
+                int from = read<int32_t>();
+                int to = read<int32_t>();
+                VehicleRoad* road = vehicle_roads[read<uint32_t>()];
+                bool is_foreward = read<char>();
+                bool is_crossing = read<char>();
+                string crossing_type = read_string();
+                values.push_back(VehicleMapValue(neighbour_id, from, to, road,
+                        is_foreward, is_crossing, crossing_type));
+            }
+        }
+        count = read<uint32_t>();
+        for (uint32_t i = 0; i < count; ++i) {
+            object_id_type node_id = read<object_id_type>();
+            Location location;
+            location.set_x(read<int32_t>());
+            location.set_y(read<int32_t>());
+            if (with_locations) {
+                location_index.set(node_id, location);
+            }
+        }
+        if (with_locations) {
+            location_index.sort();
+        }
+    }
+
+public:
+
+    /***
+     * Stages of the pipeline in main(). The checkpoint of a stage holds the
+     * DataStorage after this stage.
+     */
+    static const vector<string>& stages() {
+        static const vector<string> stage_names = {"ingestion", "sidewalks",
+                "contrast", "crossings", "connection"};
+        return stage_names;
+    }
+
+    /***
+     * Position of the stage in stages() or -1 if unknown.
+     */
+    static int stage_index(string stage) {
+        const vector<string>& stage_names = stages();
+        for (size_t i = 0; i < stage_names.size(); ++i) {
+            if (stage_names[i] == stage) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    static string get_path(string directory, string stage) {
+        return directory + "/" + stage + ".ckpt";
+    }
+
+    static string get_index_path(string directory, string stage) {
+        return directory + "/" + stage + ".orthos";
+    }
+
+    explicit Checkpoint(DataStorage& data_storage,
+            index_pos_type& location_index,
+            location_handler_type& location_handler) :
+            ds(data_storage),
+            location_index(location_index),
+            location_handler(location_handler),
+            out(nullptr),
+            in_position(nullptr),
+            in_end(nullptr) {
+    }
+
+    /***
+     * Write the DataStorage after the given stage. The temporary maps of the
+     * single stages are not stored.
+     */
+    void save(string directory, string stage) {
+        string path = get_path(directory, stage);
+        out = fopen(path.c_str(), "wb");
+        if (!out) {
+            cerr << "Failed to open checkpoint " << path << endl;
+            exit(1);
+        }
+        write_raw(MAGIC, strlen(MAGIC));
+        write(stage);
+
+        google::sparse_hash_map<VehicleRoad*, uint32_t> vehicle_roads;
+        vehicle_roads.set_deleted_key(nullptr);
+        write<uint32_t>(ds.vehicle_road_set.size());
+        for (VehicleRoad* road : ds.vehicle_road_set) {
+            uint32_t road_index = vehicle_roads.size();
+            vehicle_roads[road] = road_index;
+            write_road(road);
+            write(road->osm_id);
+            write<int32_t>(road->lanes);
+            write<char>(road->sidewalk);
+        }
+        write<uint32_t>(ds.pedestrian_road_set.size());
+        for (PedestrianRoad* road : ds.pedestrian_road_set) {
+            write_road(road);
+            write(road->osm_id);
+        }
+        write<uint32_t>(ds.sidewalk_map.size());
+        for (auto map_entry : ds.sidewalk_map) {
+            Sidewalk* sidewalk = map_entry.second;
+            write_road(sidewalk);
+            write(sidewalk->osm_id);
+            write(sidewalk->at_osm_type);
+        }
+        write<uint32_t>(ds.crossing_set.size());
+        for (Crossing* crossing : ds.crossing_set) {
+            write_road(crossing);
+            write(crossing->osm_type);
+        }
+        write<uint32_t>(ds.crossing_pairs.size());
+        for (CrossingPair* crossing_pair : ds.crossing_pairs) {
+            write(crossing_pair->sidewalk_id);
+            write(crossing_pair->neighbour_id);
+            write<double>(crossing_pair->sidewalk_point.x);
+            write<double>(crossing_pair->sidewalk_point.y);
+            write<double>(crossing_pair->neighbour_point.x);
+            write<double>(crossing_pair->neighbour_point.y);
+            write(crossing_pair->type);
+        }
+        write<uint32_t>(ds.intersects.size());
+        for (const Intersect& intersect : ds.intersects) {
+            write<uint32_t>(intersect.coords.size());
+            for (const Coordinate& coord : intersect.coords) {
+                write<double>(coord.x);
+                write<double>(coord.y);
+            }
+            write<double>(intersect.length);
+            write<double>(intersect.ratio);
+        }
+        write<uint32_t>(ds.orthos.size());
+        for (Orthogonal* ortho : ds.orthos) {
+            write<double>(ortho->start.x);
+            write<double>(ortho->start.y);
+            write<double>(ortho->end.x);
+            write<double>(ortho->end.y);
+            write<double>(ortho->distance);
+        }
+        write<uint32_t>(ds.crossing_node_map.size());
+        for (auto map_entry : ds.crossing_node_map) {
+            write<object_id_type>(map_entry.first);
+            write(map_entry.second->type);
+        }
+        write<uint32_t>(ds.vehicle_node_map.size());
+        for (auto map_entry : ds.vehicle_node_map) {
+            write<object_id_type>(map_entry.first);
+            write<uint32_t>(map_entry.second.size());
+            for (VehicleMapValue& value : map_entry.second) {
+                write<object_id_type>(value.node_id);
+                write<int32_t>(value.from);
+                write<int32_t>(value.to);
+                write<uint32_t>(vehicle_roads[value.vehicle_road]);
+                write<char>(value.is_foreward);
+                write<char>(value.is_crossing);
+                write(value.crossing_type);
+            }
+        }
+        /* every neighbour is also a key of the vehicle_node_map */
+        write<uint32_t>(ds.vehicle_node_map.size());
+        for (auto map_entry : ds.vehicle_node_map) {
+            Location location = location_handler.get_node_location(
+                    map_entry.first);
+            write<object_id_type>(map_entry.first);
+            write<int32_t>(location.x());
+            write<int32_t>(location.y());
+        }
+        if (fclose(out) != 0) {
+            cerr << "Failed to write checkpoint " << path << endl;
+            exit(1);
+        }
+        out = nullptr;
+        if (!ds.orthos.empty()) {
+            ds.ortho_index.save(get_index_path(directory, stage));
+        }
+    }
+
+    /***
+     * Map the checkpoint of the given stage into memory and restore the
+     * DataStorage. The DataStorage has to be empty. The node locations are
+     * skipped if they are still in the location index, e.g. in a sweep.
+     */
+    void load(string directory, string stage, bool with_locations = true) {
+        string path = get_path(directory, stage);
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            cerr << "Failed to open checkpoint " << path << endl;
+            exit(1);
+        }
+        struct stat file_stat;
+        if ((fstat(fd, &file_stat) != 0) || (file_stat.st_size == 0)) {
+            cerr << "Failed to read checkpoint " << path << endl;
+            exit(1);
+        }
+        size_t size = file_stat.st_size;
+        void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            cerr << "Failed to map checkpoint " << path << endl;
+            exit(1);
+        }
+        in_position = static_cast<const char*>(data);
+        in_end = in_position + size;
+
+        char magic[8];
+        read_raw(magic, sizeof(magic));
+        if ((memcmp(magic, MAGIC, sizeof(magic)) != 0) ||
+                (read_string() != stage)) {
+            cerr << path << " is no checkpoint of stage " << stage << endl;
+            exit(1);
+        }
+        google::sparse_hash_map<uint32_t, VehicleRoad*> vehicle_roads;
+        restore(vehicle_roads, with_locations);
+
+        munmap(data, size);
+        in_position = nullptr;
+        in_end = nullptr;
+        if (!ds.orthos.empty()) {
+            ds.ortho_index.load(get_index_path(directory, stage));
+        }
+    }
+};
+
+#endif /* CHECKPOINT_HPP_ */
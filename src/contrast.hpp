@@ -13,64 +13,113 @@
 #ifndef CONTRAST_HPP_
 #define CONTRAST_HPP_
 
-typedef pair<Geometry*, double> ortho_pair_type;
-typedef google::sparse_hash_set<Sidewalk*> detect_set_type;
+/* detected sidewalks with the ratio of their intersections */
+typedef google::sparse_hash_map<Sidewalk*, double> detect_set_type;
 
 class Contrast {
+
+    /***
+     * State of one worker thread. The workers share the sidewalks and the
+     * orthogonals, so they only read their coordinates and the envelopes
+     * cached by join_orthos. No GEOS geometry is created or operated on,
+     * this would change the reference count of the shared factory. Each
+     * worker has its own GeomOperate for the plain coordinate kernels. The
+     * results are merged after all workers are finished, so they do not
+     * depend on the number of threads.
+     */
+    struct ContrastWorker {
+        GeomOperate go;
+        vector<pair<size_t, double>> distances;  // ortho position, distance
+        vector<pair<Sidewalk*, double>> sidewalks; // detected or erased,
+                                                   // with the ratio
+    };
+
+    /***
+     * Values of a sidewalk used for every orthogonal, calculated once.
+     */
+    struct SidewalkShape {
+        Geometry* geometry;
+        const CoordinateSequence* coords;
+        Coordinate direction;
+        double direction_squared;
+    };
+
     DataStorage& ds;
     GeomOperate go;
-    GeometryFactory geos_factory;
-
-    //PARAMETERS
-    const double segment_size = 0.01;        // distance between orthogonal
-                                             // lines
-    const double ortho_length = 0.015;       // length of the orthogonal
-                                             // line
-    const double contrast_factor = 0.7;      // if 80% of the segments
-                                             // intersects
-                                             // with the sidewalk
-    const double orientation_tolerance = 15; // tolerance in degrees, for the
-                                             // orientation of sidewalk and
-                                             // pedestrian road
-    const double min_length = 0.05;          // minimal length of used
-                                             // PedestrianRoad
-
-    /***
-     * Insert the pair of orthogonals into a tree structure to improve the
-     * query time.
+    unsigned int num_threads;
+
+    //PARAMETERS, see parameters.hpp
+    const double segment_size = Parameters::get().segment_size;
+    const double ortho_length = Parameters::get().ortho_length;
+    const double contrast_factor = Parameters::get().contrast_factor;
+    const double orientation_tolerance =
+            Parameters::get().orientation_tolerance;
+    const double min_length = Parameters::get().min_length;
+    const double max_cos_squared;            // squared cosine of
+                                             // 90 - orientation_tolerance
+
+    /***
+     * Store the orthogonal, they are joined with the sidewalks in one batch.
      */
-    void insert_in_tree(ortho_pair_type* ortho_pair) {
-        ds.ortho_tree.insert(ortho_pair->first->getEnvelopeInternal(),
-                ortho_pair);
+    void insert_ortho(Orthogonal* ortho) {
+        ds.orthos.push_back(ortho);
     }
 
     /***
-     * Get distance between centroid of othogonal segment and sidewalk geometry.
+     * Join the envelopes of the sidewalks with the orthogonals. The pairs
+     * (sidewalk position, ortho position) are sorted by the sidewalk.
      */
-    double get_distance(Geometry* sidewalk, ortho_pair_type* ortho_pair) {
-        Point* ortho_mid = ortho_pair->first->getCentroid();
-        const Point* c_ortho_mid = const_cast<const Point*>(ortho_mid);
-        double distance = sidewalk->distance(c_ortho_mid);
-        return distance;
+    void join_orthos(const vector<Sidewalk*>& sidewalks,
+            vector<join_pair_type>& pairs) {
+
+        vector<const Envelope*> sidewalk_envelopes;
+        sidewalk_envelopes.reserve(sidewalks.size());
+        for (Sidewalk* sidewalk : sidewalks) {
+            sidewalk_envelopes.push_back(
+                    sidewalk->geometry->getEnvelopeInternal());
+        }
+        SpatialJoin spatial_join(num_threads);
+        spatial_join.join(sidewalk_envelopes, ds.ortho_index, pairs);
+    }
+
+    SidewalkShape get_shape(ContrastWorker& worker, Sidewalk* sidewalk_road) {
+        SidewalkShape shape;
+        shape.geometry = sidewalk_road->geometry;
+        shape.coords = dynamic_cast<LineString*>(
+                shape.geometry)->getCoordinatesRO();
+        shape.direction = worker.go.direction(dynamic_cast<LineString*>(
+                shape.geometry));
+        shape.direction_squared = worker.go.dot_product(shape.direction,
+                shape.direction);
+        return shape;
     }
 
     /***
-     * Clue the shortest intersection distance to the orthogonal line.
+     * Get distance between the midpoint of the othogonal and the sidewalk
+     * geometry.
      */
-    void set_distance(Geometry* sidewalk, ortho_pair_type* ortho_pair) {
-        double distance = get_distance(sidewalk, ortho_pair);
-        if (distance < ortho_pair->second) {
-            ortho_pair->second = distance;
+    double get_distance(const SidewalkShape& shape, const Orthogonal* ortho) {
+        double distance = -1;
+        for (size_t i = 0; i + 1 < shape.coords->getSize(); ++i) {
+            LineSegment segment(shape.coords->getAt(i),
+                    shape.coords->getAt(i + 1));
+            double segment_distance = segment.distance(ortho->midpoint);
+            if ((distance < 0) || (segment_distance < distance)) {
+                distance = segment_distance;
+            }
         }
+        return distance;
     }
 
     /***
      * Compare the current distance to the stored distance with the orthogonal.
      */
-    bool is_shortest_distance(Geometry* sidewalk, ortho_pair_type* ortho_pair) {
+    bool is_shortest_distance(const SidewalkShape& shape,
+            const Orthogonal* ortho) {
+
         double tolerance = 0.0000005; // ca. 5cm
-        double current_distance = get_distance(sidewalk, ortho_pair);
-        double shortest_distance = ortho_pair->second;
+        double current_distance = get_distance(shape, ortho);
+        double shortest_distance = ortho->distance;
         if (abs(current_distance - shortest_distance) < tolerance) {
             return true;
         }
@@ -78,31 +127,71 @@ class Contrast {
     }
 
     /***
-     * Compare the amount of intersections with the length of the segment.
+     * Test if the orientation of the sidewalk and the orthogonals are close to
+     * 90 degrees (orientation_toleance). The cosine of the angle between both
+     * precomputed directions is compared squared, so no angle is calculated.
      */
-    double compare_to_length(int count_intersects, double length) {
-        double count_segments = length / segment_size;
-        double ratio = static_cast<double>(count_intersects) / count_segments;
-        return ratio;
+    bool similar_orientation(ContrastWorker& worker,
+            const SidewalkShape& shape, const Orthogonal* ortho) {
+
+        double dot = worker.go.dot_product(shape.direction, ortho->direction);
+        return dot * dot < max_cos_squared * shape.direction_squared *
+                ortho->direction_squared;
     }
 
     /***
-     * Test if the orientation of the sidewalk and the orthogonals are close to
-     * 90 degrees (orientation_toleance)
+     * Intersects test of a sidewalk and an orthogonal. Each sidewalk segment
+     * is tested with the envelope of the orthogonal first and then with the
+     * segment kernel of GeomOperate. Collinear segments with overlapping
+     * envelopes overlap, so GEOS is not needed for them.
      */
-    bool similar_orientation(Geometry* sidewalk, Geometry* ortho_line) {
-        double angle = go.angle(dynamic_cast<LineString*>(sidewalk),
-                dynamic_cast<LineString*>(ortho_line));
-        if (angle > 180) {
-            angle -= 180;
-        }
-        if ((angle > 90 - orientation_tolerance) &&
-                (angle < 90 + orientation_tolerance)) {
-            return true;
+    bool intersects(ContrastWorker& worker, const SidewalkShape& shape,
+            const Orthogonal* ortho) {
+
+        double ortho_min_x = min(ortho->start.x, ortho->end.x);
+        double ortho_max_x = max(ortho->start.x, ortho->end.x);
+        double ortho_min_y = min(ortho->start.y, ortho->end.y);
+        double ortho_max_y = max(ortho->start.y, ortho->end.y);
+        for (size_t i = 0; i + 1 < shape.coords->getSize(); ++i) {
+            const Coordinate& start = shape.coords->getAt(i);
+            const Coordinate& end = shape.coords->getAt(i + 1);
+            if ((max(start.x, end.x) < ortho_min_x) ||
+                    (min(start.x, end.x) > ortho_max_x) ||
+                    (max(start.y, end.y) < ortho_min_y) ||
+                    (min(start.y, end.y) > ortho_max_y)) {
+                continue;
+            }
+            Coordinate coord;
+            int result = worker.go.segment_intersection(start, end,
+                    ortho->start, ortho->end, coord);
+            if ((result == point_intersection) ||
+                    (result == collinear_intersection)) {
+                return true;
+            }
         }
         return false;
     }
 
+    /***
+     * Rejection cascade of a sidewalk and an orthogonal, the cheap test of
+     * the precomputed orientations comes first.
+     */
+    bool is_hit(ContrastWorker& worker, const SidewalkShape& shape,
+            const Orthogonal* ortho) {
+
+        return similar_orientation(worker, shape, ortho) &&
+                intersects(worker, shape, ortho);
+    }
+
+    /***
+     * Compare the amount of intersections with the length of the segment.
+     */
+    double compare_to_length(int count_intersects, double length) {
+        double count_segments = length / segment_size;
+        double ratio = static_cast<double>(count_intersects) / count_segments;
+        return ratio;
+    }
+
     /***
      * Checks sidewalks intesecting orthogonals with similar orientation
      * (= 90 degree +- orientation_toleance). For each sidewalk the number
@@ -110,110 +199,176 @@ class Contrast {
      * linestring higher than the constrast factor, the sidewalk is stored in
      * the detect map. The distance of the closest sidewalk to the centroid of
      * the orthogonal is clued to the orthogonal.
+     * The sidewalks are checked in parallel, the workers collect the
+     * distances and the minimum is taken afterwards.
      */
     void find_possible_positives(detect_set_type& detect_set) {
+        vector<Sidewalk*> sidewalks;
+        sidewalks.reserve(ds.sidewalk_map.size());
         for (auto map_entry : ds.sidewalk_map) {
-            Sidewalk* sidewalk_road = map_entry.second;
-            vector<void *> results;
-            Geometry* sidewalk = sidewalk_road->geometry;
-            ds.ortho_tree.query(sidewalk->getEnvelopeInternal(), results);
-            if (results.size() > 1) {
-                int count_intersects = 0;
-                Geometry* ortho_line = nullptr;
-                for (auto result : results) {
-                    ortho_pair_type* ortho_pair =
-                            static_cast<ortho_pair_type*>(result);
-                    ortho_line = ortho_pair->first;
-                    if (sidewalk->intersects(
-                            const_cast<const Geometry*>(ortho_line))) {
-                        if (similar_orientation(sidewalk, ortho_line)) {
-                            set_distance(sidewalk, ortho_pair);
-                            count_intersects++;
-                        }
-                    }
+            sidewalks.push_back(map_entry.second);
+        }
+        vector<join_pair_type> pairs;
+        join_orthos(sidewalks, pairs);
+        vector<size_t> group_begins;
+        for (size_t begin = 0; begin < pairs.size();
+                begin = SpatialJoin::group_end(pairs, begin)) {
+            group_begins.push_back(begin);
+        }
+        vector<ContrastWorker> workers(num_threads);
+        run_parallel<ContrastWorker>(workers, group_begins.size(),
+                [&](ContrastWorker& worker, size_t group) {
+            size_t begin = group_begins[group];
+            size_t end = SpatialJoin::group_end(pairs, begin);
+            if (end - begin < 2) {
+                return;
+            }
+            Sidewalk* sidewalk_road = sidewalks[pairs[begin].first];
+            SidewalkShape shape = get_shape(worker, sidewalk_road);
+            int count_intersects = 0;
+            for (size_t i = begin; i < end; ++i) {
+                Orthogonal* ortho = ds.orthos[pairs[i].second];
+                if (is_hit(worker, shape, ortho)) {
+                    worker.distances.push_back(pair<size_t, double>(
+                            pairs[i].second, get_distance(shape, ortho)));
+                    count_intersects++;
                 }
-                double ratio = compare_to_length(count_intersects,
-                        sidewalk_road->length);
-                if (ratio > contrast_factor) {
-                    string sidewalk_id = sidewalk_road->id;
-                    detect_set.insert(sidewalk_road);
+            }
+            double ratio = compare_to_length(count_intersects,
+                    sidewalk_road->length);
+            if (ratio > contrast_factor) {
+                worker.sidewalks.push_back(pair<Sidewalk*, double>(
+                        sidewalk_road, ratio));
+            }
+        });
+        for (ContrastWorker& worker : workers) {
+            for (auto distance : worker.distances) {
+                Orthogonal* ortho = ds.orthos[distance.first];
+                if (distance.second < ortho->distance) {
+                    ortho->distance = distance.second;
                 }
             }
+            for (auto detected : worker.sidewalks) {
+                detect_set[detected.first] = detected.second;
+            }
         }
     }
 
     /***
      * Does the same as find_possible_positives, but iterates over the
      * detect_set and the distance to the orthogonal is the shortest.
+     * The few detected sidewalks query the packed R-tree of the orthogonals
+     * instead of joining all orthogonals again. The orthogonals are only
+     * read, the sidewalks to erase are collected by the workers.
      */
     void find_closest_positives(detect_set_type& detect_set) {
-        for (auto sidewalk_road : detect_set) {
-            vector<void *> results;
-            Geometry* sidewalk = sidewalk_road->geometry;
-            ds.ortho_tree.query(sidewalk->getEnvelopeInternal(), results);
-            if (results.size() > 1) {
-                int count_intersects = 0;
-                Geometry* ortho_line = nullptr;
-                for (auto result : results) {
-                    ortho_pair_type* ortho_pair = static_cast<ortho_pair_type*>(result);
-                    ortho_line = ortho_pair->first;
-                    if (sidewalk->intersects(const_cast<const Geometry*>(ortho_line))) {
-                        if (similar_orientation(sidewalk, ortho_line)) {
-                            if (is_shortest_distance(sidewalk, ortho_pair)) {
-                                count_intersects++;
-                            }
-                        }
-                    }
+        vector<Sidewalk*> detected;
+        detected.reserve(detect_set.size());
+        for (auto entry : detect_set) {
+            detected.push_back(entry.first);
+        }
+        vector<ContrastWorker> workers(num_threads);
+        run_parallel<ContrastWorker>(workers, detected.size(),
+                [&](ContrastWorker& worker, size_t position) {
+            Sidewalk* sidewalk_road = detected[position];
+            SidewalkShape shape = get_shape(worker, sidewalk_road);
+            int count_candidates = 0;
+            int count_intersects = 0;
+            ds.ortho_index.query(*shape.geometry->getEnvelopeInternal(),
+                    [&](size_t ortho_position) {
+                count_candidates++;
+                Orthogonal* ortho = ds.orthos[ortho_position];
+                if (is_hit(worker, shape, ortho) &&
+                        is_shortest_distance(shape, ortho)) {
+                    count_intersects++;
                 }
+            });
+            if (count_candidates > 1) {
                 double ratio = compare_to_length(count_intersects,
                         sidewalk_road->length);
                 if (ratio > contrast_factor) {
-                    string sidewalk_id = sidewalk_road->id;
-                    ds.sidewalk_map.erase(sidewalk_id);
+                    worker.sidewalks.push_back(pair<Sidewalk*, double>(
+                            sidewalk_road, ratio));
                 }
             }
+        });
+        for (ContrastWorker& worker : workers) {
+            for (auto erased : worker.sidewalks) {
+                ds.sidewalk_map.erase(erased.first->id);
+            }
         }
     }
 
 public:
 
-    explicit Contrast(DataStorage& data_storage) :
-            ds(data_storage) {
+    /***
+     * num_threads is the number of worker threads of check_sidewalks.
+     */
+    explicit Contrast(DataStorage& data_storage,
+            unsigned int num_threads = 1) :
+            ds(data_storage),
+            num_threads(max(num_threads, 1u)),
+            max_cos_squared(pow(cos((90 - orientation_tolerance) *
+                    TO_RAD), 2)) {
     }
     
     /***
      * Segmentizes the PedestrianRoad and creates orthogonals each
-     * segment_size.
+     * segment_size. The lines are created by the factory of the
+     * DataStorage, which frees them.
      */
     void create_orthogonals(Geometry* geometry) {
         LineString* linestring = dynamic_cast<LineString*>(geometry);
-        CoordinateSequence *coords;
-        coords = linestring->getCoordinates();
-        for (unsigned int i = 0; i < (coords->getSize() - 1); i++) {
-            Coordinate start = coords->getAt(i);
-            Coordinate end = coords->getAt(i + 1);
-            Point* end_point = geos_factory.createPoint(end);
-            if (go.haversine(start, end) < min_length) {
+        const CoordinateSequence *coords;
+        coords = linestring->getCoordinatesRO();
+        vector<double> lengths;
+        vector<Coordinate> splits;
+        go.segment_lengths(coords, lengths);
+        for (unsigned int i = 0; i < lengths.size(); i++) {
+            if (lengths[i] < min_length) {
                 continue;
             }
-            for (Coordinate coord : go.segmentize(start, end, segment_size)) {
-                Point* seg_point = geos_factory.createPoint(coord);
+            const Coordinate& start = coords->getAt(i);
+            const Coordinate& end = coords->getAt(i + 1);
+            splits.clear();
+            go.segmentize(start, end, segment_size, lengths[i], splits);
+            for (Coordinate coord : splits) {
                 double closest_intersection_distance = 1;
-                LineString* ortho_line = go.orthogonal_line(seg_point,
-                        end_point, ortho_length);
-                ortho_pair_type* ortho_pair = new ortho_pair_type(
-                        ortho_line, closest_intersection_distance);
-                insert_in_tree(ortho_pair);
+                Coordinate ortho_start = go.vertical_coordinate(coord.x,
+                        coord.y, end.x, end.y, ortho_length, true);
+                Coordinate ortho_end = go.vertical_coordinate(coord.x,
+                        coord.y, end.x, end.y, ortho_length, false);
+                LineString* ortho_line = go.connect_coordinates(ortho_start,
+                        ortho_end, ds.geometry_factory);
+                insert_ortho(new Orthogonal(ortho_line, ortho_start,
+                        ortho_end, closest_intersection_distance));
                 //debug
                 //ds.insert_orthos(ortho_line);
             }
         }
     }
 
+    /***
+     * Build the packed R-tree of the orthogonals once, it is used by both
+     * steps of check_sidewalks. The checkpoint keeps it with the
+     * orthogonals.
+     */
+    void build_ortho_index() {
+        vector<const Envelope*> ortho_envelopes;
+        ortho_envelopes.reserve(ds.orthos.size());
+        for (Orthogonal* ortho : ds.orthos) {
+            ortho_envelopes.push_back(ortho->line->getEnvelopeInternal());
+        }
+        ds.ortho_index.clear();
+        SpatialJoin::fill_tree(ortho_envelopes, ds.ortho_index);
+    }
+
     /***
      * Run constrast algorithmn. First find all possible positives - all
      * intersections of the orthogonals. The second step is to find only
-     * the sidewalks with the closest intersections and erase them.
+     * the sidewalks with the closest intersections and erase them. The
+     * orthogonals and their index are created before, see
+     * build_ortho_index.
      */ 
     void check_sidewalks() {
         detect_set_type detect_set;
@@ -221,12 +376,9 @@ public:
         find_possible_positives(detect_set);
         find_closest_positives(detect_set);
 
-        for (auto detected_sidewalk : detect_set) {
-            double r = 0.7;
-            //debug
-            ds.insert_intersect(detected_sidewalk->geometry,
-                    detected_sidewalk->length, r);
-                    
+        for (auto detected : detect_set) {
+            ds.store_intersect(detected.first->geometry,
+                    detected.first->length, detected.second);
         }
     }
 };
@@ -23,27 +23,39 @@ class CrossingFactory {
     DataStorage& ds;
     location_handler_type& location_handler;
     GeomOperate go;
-    GeometryFactory geos_factory;
     google::sparse_hash_set<Sidewalk*> new_sidewalk_set;
     const bool left = true;
     const bool right = false;
-    const double segment_size = 0.050;
+    const double segment_size = Parameters::get().crossing_segment_size;
+    const bool risk_crossings = Profile::get().risk_crossings;
+    vector<Crossing*>* crossing_buffer;
 
     /***
      * Create new corssing object of given start and end point, with an ID and
      * a length. Insert object into crossing_set.
      */
-    void insert_crossing(Point* start, Point* end, Sidewalk* sidewalk,
-            string type, string osm_type) {
+    void insert_crossing(const Coordinate& start, const Coordinate& end,
+            Sidewalk* sidewalk, string type, string osm_type) {
 
         Geometry* geometry = nullptr;
-        geometry = go.connect_points(start, end);
+        geometry = go.connect_coordinates(start, end);
         CrossingID cid(sidewalk->id, true, 1);
         double length = go.get_length(geometry);
         Crossing* crossing = nullptr;
         crossing = new Crossing(cid, sidewalk->name, geometry, type,
                 osm_type, length);
-        ds.crossing_set.insert(crossing);
+        if (crossing_buffer) {
+            crossing_buffer->push_back(crossing);
+        } else {
+            ds.crossing_set.insert(crossing);
+        }
+    }
+
+    /***
+     * Frequent risk crossings are left out, if the profile avoids them.
+     */
+    bool is_used_type(string crossing_type) {
+        return risk_crossings || (crossing_type != "risk-crossing");
     }
 
     /* Figure out the start and end point of the crossing depending on the
@@ -54,95 +66,113 @@ class CrossingFactory {
         
         LineString* segment1 = dynamic_cast<LineString*>(sidewalk1->geometry);
         LineString* segment2 = dynamic_cast<LineString*>(sidewalk2->geometry);
-        Point* start_point;
-        Point* end_point;
-        if (reverse_first) {
-            start_point = segment1->getEndPoint();
-        } else {
-            start_point = segment1->getStartPoint();
-        }
-        if (reverse_second) {
-            end_point = segment2->getEndPoint();
-        } else {
-            end_point = segment2->getStartPoint();
-        }
-        insert_crossing(start_point, end_point, sidewalk1, "osm-crossing", osm_type);
+        insert_crossing(go.end_coordinate(segment1, reverse_first),
+                go.end_coordinate(segment2, reverse_second), sidewalk1,
+                "osm-crossing", osm_type);
     }
     
     /***
-     * split_sidewalk takes a Sidewalk object and cut it to the given point.
-     * From the split_point till the end a new Sidewalk is created with a new
-     * ID. The new Sildewalk is the return value.
+     * Points every segment_size along the segments of the linestring, which
+     * are longer than segment_size. The index of the segment of each point
+     * is stored in split_segments.
      */
-    Sidewalk* split_sidewalk(Sidewalk*& sidewalk, Point* split_point, int index) {
-        LineString* origin_geometry = dynamic_cast<LineString*>(sidewalk->geometry);
-        LineString* first_segment = nullptr;
-        LineString* second_segment = nullptr;
-        Sidewalk* new_sidewalk = nullptr;
-        int num_points = sidewalk->geometry->getNumPoints();
-        if (num_points == 2) {
-            first_segment = go.set_point(origin_geometry, split_point, true);
-            second_segment = go.set_point(origin_geometry, split_point, false);
-        } else {
-            for (int i = 0; i < num_points - 1; ++i) {
-                if (go.point_is_between(split_point,
-                        origin_geometry->getPointN(i),
-                        origin_geometry->getPointN(i + 1))) {
-                    first_segment = go.set_point(origin_geometry, split_point, i + 1);
-                    if ((i + 1) < (num_points - 1)) {
-                        first_segment = go.cut_line(first_segment, i + 1, true);
-                    }
-                    second_segment = go.set_point(origin_geometry, split_point, i);
-                    if (i > 0) {
-                        second_segment = go.cut_line(second_segment, i, false);
-                    }
-                    break;
-                }
+    void get_split_points(LineString* linestring,
+            vector<Coordinate>& split_points,
+            vector<size_t>& split_segments) {
+
+        const CoordinateSequence* coords = linestring->getCoordinatesRO();
+        vector<double> lengths;
+        go.segment_lengths(coords, lengths);
+        vector<Coordinate> segment_splits;
+        for (unsigned int i = 0; i < lengths.size(); i++) {
+            if (lengths[i] < segment_size) {
+                continue;
             }
+            segment_splits.clear();
+            go.segmentize(coords->getAt(i), coords->getAt(i + 1),
+                    segment_size, lengths[i], segment_splits);
+            split_points.insert(split_points.end(), segment_splits.begin(),
+                    segment_splits.end());
+            split_segments.insert(split_segments.end(),
+                    segment_splits.size(), i);
         }
-        if (first_segment) {
-            sidewalk->geometry = first_segment;
-        } else {
-            cerr << "unexcepted error in split_sidewalk / CrossingFactory"
-                << endl;
-            exit(1);
+    }
+
+    /***
+     * Pair the split points of a sidewalk and its neighbour, which are at
+     * the same position along the road. Both sidewalks follow the road, so
+     * each sidewalk split point is projected onto the neighbour and paired
+     * with the neighbour split point closest to this position. Split points
+     * without a partner within half a segment_size get no crossing, e.g. on
+     * a curve where only one side has a segment longer than segment_size.
+     * The pairs hold the positions in sidewalk_splits and neighbour_splits.
+     */
+    void pair_split_points(const LineString* neighbour_line,
+            const vector<Coordinate>& sidewalk_splits,
+            const vector<Coordinate>& neighbour_splits,
+            const vector<size_t>& neighbour_segments,
+            vector<pair<size_t, size_t>>& split_pairs) {
+
+        split_pairs.clear();
+        if (sidewalk_splits.empty() || neighbour_splits.empty()) {
+            return;
         }
-        if (second_segment) {
-            new_sidewalk = new Sidewalk(sidewalk, second_segment, index);
-            new_sidewalk_set.insert(new_sidewalk);
-        } else {
-            cerr << "unexcepted error in split_sidewalk / CrossingFactory"
-                << endl;
-            exit(1);
+        const CoordinateSequence* coords = neighbour_line->getCoordinatesRO();
+        vector<double> lengths;
+        vector<double> offsets;
+        go.segment_lengths(coords, lengths);
+        go.vertex_offsets(lengths, offsets);
+        vector<double> positions;
+        positions.reserve(neighbour_splits.size());
+        for (size_t j = 0; j < neighbour_splits.size(); ++j) {
+            positions.push_back(go.line_position(coords, offsets, lengths,
+                    neighbour_segments[j], neighbour_splits[j]));
+        }
+        vector<bool> used(neighbour_splits.size(), false);
+        for (size_t i = 0; i < sidewalk_splits.size(); ++i) {
+            const Coordinate& coord = sidewalk_splits[i];
+            double position = go.line_position(coords, offsets, lengths,
+                    go.closest_segment(neighbour_line, coord), coord);
+            size_t j = lower_bound(positions.begin(), positions.end(),
+                    position) - positions.begin();
+            if ((j == positions.size()) || ((j > 0) &&
+                    (position - positions[j - 1] < positions[j] - position))) {
+                --j;
+            }
+            if (!used[j] && (abs(positions[j] - position) <=
+                    segment_size / 2)) {
+                used[j] = true;
+                split_pairs.push_back(pair<size_t, size_t>(i, j));
+            }
         }
-        return new_sidewalk;
     }
-    
+
     /***
-     * Segmentize a sidewalk geometry and store the split points into the given
-     * vector.
+     * Split a sidewalk at the split points of get_split_points. The
+     * sidewalk is split at all points of all segments in one pass of
+     * GeomOperate::split_line. The sidewalk keeps the first piece, for the
+     * other pieces new Sidewalks are created. The index of the new IDs starts
+     * with 2 and continues over the segments, so the pieces of a chain
+     * sidewalk get different IDs. The last piece is returned in sidewalk.
      */
-    void segmentize_sidewalk(Sidewalk*& sidewalk, vector<Coordinate>&
-            split_points) {
+    void segmentize_sidewalk(Sidewalk*& sidewalk,
+            const vector<Coordinate>& split_points,
+            const vector<size_t>& split_segments) {
 
         LineString* linestring = dynamic_cast<LineString*>(
                 sidewalk->geometry);
-        CoordinateSequence *coords;
-        coords = linestring->getCoordinates();
-        for (unsigned int i = 0; i < (coords->getSize() - 1); i++) {
-            Coordinate start = coords->getAt(i);
-            Coordinate end = coords->getAt(i + 1);
-            if (go.haversine(start, end) < segment_size) {
-                continue;
-            }
-            //Point* end_point = geos_factory.createPoint(end);
-            split_points = go.segmentize(start, end, segment_size);
-            int index = 2;
-            for (Coordinate coord : split_points) {
-                Point* seg_point = geos_factory.createPoint(coord);
-                sidewalk = split_sidewalk(sidewalk, seg_point, index);   
-                index++;
-            }
+        if (split_points.empty()) {
+            return;
+        }
+        vector<double> piece_lengths;
+        vector<LineString*> pieces = go.split_line(linestring, split_points,
+                split_segments, piece_lengths);
+        sidewalk->geometry = pieces[0];
+        sidewalk->length = piece_lengths[0];
+        for (unsigned int i = 1; i < pieces.size(); i++) {
+            sidewalk = new Sidewalk(sidewalk, pieces[i], i + 1,
+                    piece_lengths[i]);
+            new_sidewalk_set.insert(sidewalk);
         }
     }
 
@@ -150,11 +180,28 @@ public:
 
     explicit CrossingFactory(DataStorage& data_storage,
             location_handler_type& location_handler) :
-            ds(data_storage), location_handler(location_handler) {
+            ds(data_storage), location_handler(location_handler),
+            crossing_buffer(nullptr) {
 
         new_sidewalk_set.set_deleted_key(nullptr);
     }
 
+    /***
+     * Create the geometries with the given factory, which has to outlive
+     * them, see DataStorage::get_worker_factory.
+     */
+    void set_factory(const GeometryFactory* factory) {
+        go.set_factory(factory);
+    }
+
+    /***
+     * If set, new crossings are stored in buffer instead of the
+     * crossing_set, e.g. by a worker thread.
+     */
+    void set_crossing_buffer(vector<Crossing*>* buffer) {
+        crossing_buffer = buffer;
+    }
+
     /***
      * Create OSM crossing of two parallel sidewalks, called by
      * GeometryConstructor.
@@ -174,13 +221,18 @@ public:
     /***
      * Each road can be crossed beside official crossings. To realize the
      * crossing behavior each sidewalk is segmentized by segment_size.
-     * Crossing of larger roads is marked as a risk crossing.
+     * The crossings connect the split points at the same position along the
+     * road, see pair_split_points. Crossing of larger roads is marked as a
+     * risk crossing.
      */
     void generate_frequent_crossings() {
         google::sparse_hash_set<string> segmentized_sidewalks;
         segmentized_sidewalks.set_deleted_key("");
         vector<Coordinate> sidewalk_splits;
         vector<Coordinate> neighbour_splits;
+        vector<size_t> sidewalk_segments;
+        vector<size_t> neighbour_segments;
+        vector<pair<size_t, size_t>> split_pairs;
         for (auto map_entry : ds.sidewalk_map) {
             string sidewalk_id = map_entry.first;
             Sidewalk* sidewalk = map_entry.second;
@@ -194,25 +246,30 @@ public:
                 continue;
             }
             Sidewalk* neighbour = neighbour_pair->second;
+            LineString* neighbour_line = dynamic_cast<LineString*>(
+                    neighbour->geometry);
             sidewalk_splits.clear();
             neighbour_splits.clear();
-            segmentize_sidewalk(sidewalk, sidewalk_splits);
-            segmentize_sidewalk(neighbour, neighbour_splits);
-            int sidewalk_split_size = sidewalk_splits.size();
-            int neighbour_split_size = neighbour_splits.size();
-            if ((sidewalk_split_size != 0) && (neighbour_split_size != 0)) {
-                int min_size = min(sidewalk_split_size, neighbour_split_size);
-                for (int i = 0; i < min_size; ++i) {
-                    Point* start_point = geos_factory.createPoint(
-                            sidewalk_splits[i]);
-                    Point* end_point = geos_factory.createPoint(
-                            neighbour_splits[i]);
-                    string crossing_type =
-                            TagCheck::get_frequent_crossing_type(
-                            sidewalk->at_osm_type);
-                    insert_crossing(start_point, end_point, sidewalk,
-                            crossing_type, "");
-                }
+            sidewalk_segments.clear();
+            neighbour_segments.clear();
+            get_split_points(dynamic_cast<LineString*>(sidewalk->geometry),
+                    sidewalk_splits, sidewalk_segments);
+            get_split_points(neighbour_line, neighbour_splits,
+                    neighbour_segments);
+            string crossing_type = TagCheck::get_frequent_crossing_type(
+                    sidewalk->at_osm_type);
+            split_pairs.clear();
+            if (is_used_type(crossing_type)) {
+                pair_split_points(neighbour_line, sidewalk_splits,
+                        neighbour_splits, neighbour_segments, split_pairs);
+            }
+            segmentize_sidewalk(sidewalk, sidewalk_splits, sidewalk_segments);
+            segmentize_sidewalk(neighbour, neighbour_splits,
+                    neighbour_segments);
+            for (auto split_pair : split_pairs) {
+                insert_crossing(sidewalk_splits[split_pair.first],
+                        neighbour_splits[split_pair.second], sidewalk,
+                        crossing_type, "");
             }
             segmentized_sidewalks.insert(sidewalk_id);
             segmentized_sidewalks.insert(neighbour_id);
@@ -221,6 +278,68 @@ public:
             ds.sidewalk_map[new_sidewalk->id] = new_sidewalk;
         }
     }
+
+    /***
+     * Lazy alternative to generate_frequent_crossings. The sidewalks are not
+     * split and no crossing is created. The end points of the same
+     * crossings are stored in ds.crossing_pairs with the IDs of both
+     * sidewalks. The connection stage may still split the sidewalks, so
+     * the pieces under the end points are looked up when the crossing pairs
+     * are written, see DataStorage::insert_crossing_pairs.
+     */
+    void store_frequent_crossings() {
+        google::sparse_hash_set<string> stored_sidewalks;
+        stored_sidewalks.set_deleted_key("");
+        vector<Coordinate> sidewalk_splits;
+        vector<Coordinate> neighbour_splits;
+        vector<size_t> sidewalk_segments;
+        vector<size_t> neighbour_segments;
+        vector<pair<size_t, size_t>> split_pairs;
+        for (auto map_entry : ds.sidewalk_map) {
+            string sidewalk_id = map_entry.first;
+            Sidewalk* sidewalk = map_entry.second;
+            if (stored_sidewalks.find(sidewalk_id) !=
+                    stored_sidewalks.end()) {
+                continue;
+            }
+            string neighbour_id = sidewalk->get_neighbour_id();
+            auto neighbour_pair = ds.sidewalk_map.find(neighbour_id);
+            if (neighbour_pair == ds.sidewalk_map.end()) {
+                continue;
+            }
+            Sidewalk* neighbour = neighbour_pair->second;
+            LineString* neighbour_line = dynamic_cast<LineString*>(
+                    neighbour->geometry);
+            stored_sidewalks.insert(sidewalk_id);
+            stored_sidewalks.insert(neighbour_id);
+            string crossing_type = TagCheck::get_frequent_crossing_type(
+                    sidewalk->at_osm_type);
+            if (!is_used_type(crossing_type)) {
+                continue;
+            }
+            sidewalk_splits.clear();
+            neighbour_splits.clear();
+            sidewalk_segments.clear();
+            neighbour_segments.clear();
+            get_split_points(dynamic_cast<LineString*>(sidewalk->geometry),
+                    sidewalk_splits, sidewalk_segments);
+            get_split_points(neighbour_line, neighbour_splits,
+                    neighbour_segments);
+            pair_split_points(neighbour_line, sidewalk_splits,
+                    neighbour_splits, neighbour_segments, split_pairs);
+            for (auto split_pair : split_pairs) {
+                CrossingPair* crossing_pair = new CrossingPair();
+                crossing_pair->sidewalk_id = sidewalk_id;
+                crossing_pair->neighbour_id = neighbour_id;
+                crossing_pair->sidewalk_point =
+                        sidewalk_splits[split_pair.first];
+                crossing_pair->neighbour_point =
+                        neighbour_splits[split_pair.second];
+                crossing_pair->type = crossing_type;
+                ds.crossing_pairs.push_back(crossing_pair);
+            }
+        }
+    }
 };
 
 #endif /* CROSSING_FACTORY_HPP_ */
@@ -12,12 +12,92 @@
 #define DATASTORAGE_HPP_
 
 #include <math.h>
-#include <geos/index/strtree/STRtree.h>
+#include <cstring>
+#include <functional>
 #include <geos/index/ItemVisitor.h>
 #include <gdal/ogrsf_frmts.h> 
 #include <gdal/ogr_api.h>
 #include <string>
 
+/***
+ * Orthogonal line of a PedestrianRoad for the Contrast. The midpoint and the
+ * direction are calculated once, distance is the distance of the closest
+ * sidewalk to the midpoint.
+ */
+struct Orthogonal {
+    LineString* line;
+    Coordinate start;
+    Coordinate end;
+    Coordinate midpoint;
+    Coordinate direction;
+    double direction_squared;
+    double distance;
+
+    Orthogonal(LineString* line, const Coordinate& start,
+            const Coordinate& end, double distance) :
+            line(line),
+            start(start),
+            end(end),
+            midpoint((start.x + end.x) / 2, (start.y + end.y) / 2),
+            direction(end.x - start.x, end.y - start.y),
+            distance(distance) {
+
+        direction_squared = direction.x * direction.x +
+                direction.y * direction.y;
+    }
+};
+
+/***
+ * Frequent crossing of a sidewalk pair, which is not created (lazy
+ * crossing). The end points are the split points of
+ * CrossingFactory::pair_split_points on the sidewalk and its neighbour. The
+ * IDs are the ones of the unsplit sidewalks.
+ */
+struct CrossingPair {
+    string sidewalk_id;
+    string neighbour_id;
+    Coordinate sidewalk_point;
+    Coordinate neighbour_point;
+    string type;
+};
+
+/***
+ * Sidewalk detected by the contrast, with the ratio of its length that is
+ * covered by footways. Only the coordinates are kept, so the contrast
+ * workers do not create GEOS geometries and the checkpoint can store it.
+ */
+struct Intersect {
+    vector<Coordinate> coords;
+    double length;
+    double ratio;
+};
+
+/***
+ * Exact coordinate of a way end in the topology. The bits of the doubles
+ * are compared, so only identical ends share a vertex.
+ */
+struct VertexKey {
+    uint64_t x;
+    uint64_t y;
+
+    explicit VertexKey(const Coordinate& coord = Coordinate(0, 0)) {
+        double coord_x = coord.x + 0.0;  // -0.0 is 0.0
+        double coord_y = coord.y + 0.0;
+        memcpy(&x, &coord_x, sizeof(x));
+        memcpy(&y, &coord_y, sizeof(y));
+    }
+
+    bool operator==(const VertexKey& other) const {
+        return (x == other.x) && (y == other.y);
+    }
+};
+
+struct VertexKeyHash {
+    size_t operator()(const VertexKey& key) const {
+        return hash<uint64_t>()(key.x) ^ (hash<uint64_t>()(key.y) * 31);
+    }
+};
+
 /***
  * In the vehicle_node_map all roads are stored to create the sidewalks.
  */
@@ -53,6 +133,8 @@ class DataStorage {
     OGRDataSource* data_source;
     OGRLayer* layer_ways;
     OGRLayer* layer_intersects;
+    OGRLayer* layer_crossing_pairs;
+    OGRLayer* layer_vertices;
     //OGRLayer* layer_vehicle;
     //OGRLayer* layer_nodes;
     //OGRLayer* layer_sidewalks;
@@ -62,6 +144,23 @@ class DataStorage {
     geom::OGRFactory<> ogr_factory;
     geom::GEOSFactory<> geos_factory;
     GeometryFactory geometry_factory;
+    vector<GeometryFactory*> worker_factories;  // see get_worker_factory
+
+    /* topology: vertex ids (from 1) of the way ends and the field indices
+     * in the ways layer, shapefiles may shorten the names */
+    google::sparse_hash_map<VertexKey, int, VertexKeyHash> vertex_ids;
+    vector<Coordinate> vertices;
+    vector<int> vertex_counts;
+    int field_source;
+    int field_target;
+    int field_cost;
+    int field_reverse_cost;
+
+    /* id of the ways (from 1), the sidewalks keep theirs for the crossing
+     * pairs */
+    int field_id;
+    int way_counter;
+    google::sparse_hash_map<Sidewalk*, int> sidewalk_way_ids;
 
     const char* SRS = "WGS84";
     long gid;
@@ -84,9 +183,9 @@ class DataStorage {
     }
 
     /***
-     * Crate OGR column.
+     * Crate OGR column. Returns the index of the column.
      */
-    void create_field(OGRLayer* &layer, const char* name, OGRFieldType type,
+    int create_field(OGRLayer* &layer, const char* name, OGRFieldType type,
             int width = 0) {
 
         OGRFieldDefn ogr_field(name, type);
@@ -97,6 +196,7 @@ class DataStorage {
             cerr << "Creating " << name << " field failed." << endl;
             exit(1);
         }
+        return layer->GetLayerDefn()->GetFieldCount() - 1;
     }
 
     /***
@@ -134,12 +234,22 @@ class DataStorage {
 
         create_table(layer_ways, "ways", wkbLineString);
         //create_field(layer_ways, "gid", OFTInteger); 
+        field_id = create_field(layer_ways, "id", OFTInteger);
         create_field(layer_ways, "class_id", OFTInteger);
         create_field(layer_ways, "type", OFTString, 20);
         create_field(layer_ways, "osm_type", OFTString, 14);
         create_field(layer_ways, "length", OFTReal);
         create_field(layer_ways, "name", OFTString, 40);
         create_field(layer_ways, "osm_id", OFTString, 14); 
+        field_source = create_field(layer_ways, "source", OFTInteger);
+        field_target = create_field(layer_ways, "target", OFTInteger);
+        field_cost = create_field(layer_ways, "cost", OFTReal);
+        field_reverse_cost = create_field(layer_ways, "reverse_cost",
+                OFTReal);
+
+        create_table(layer_vertices, "vertices", wkbPoint);
+        create_field(layer_vertices, "id", OFTInteger);
+        create_field(layer_vertices, "cnt", OFTInteger);
 
         /*create_table(layer_vehicle, "vehicle", wkbLineString);
         create_field(layer_vehicle, "gid", OFTInteger, 10); 
@@ -159,6 +269,9 @@ class DataStorage {
         create_table(layer_intersects, "intersects", wkbLineString);
         create_field(layer_intersects, "length", OFTReal);
         create_field(layer_intersects, "ratio", OFTReal);
+
+        /* created by insert_crossing_pairs, only with lazy crossings */
+        layer_crossing_pairs = nullptr;
 /*
         create_table(layer_sidewalks, "sidewalks", wkbLineString);
         create_field(layer_sidewalks, "id", OFTString, 16);
@@ -170,29 +283,137 @@ class DataStorage {
     }
 
     /***
-     * for the geometric creations of the sidewalks a clockwise order is
-     * neccessary.
+     * Set the geometry of a reused feature. The OGRLineString is handed to
+     * the feature and taken back after the insert by release_geometry, so
+     * one feature and one geometry are used for a whole layer. Other
+     * geometry types than LineString are converted by geos2ogr.
      */
-    void order_clockwise(object_id_type node_id) {
-        Location node_location; 
-        Location last_location; 
-        int vector_size = vehicle_node_map[node_id].size();
-        node_location = location_handler.get_node_location(node_id);
-        last_location = location_handler.get_node_location(
-                vehicle_node_map[node_id][vector_size - 1].node_id);
-
-        double angle_last = go.orientation(node_location, last_location);
-        for (int i = vector_size - 1; i > 0; --i) {
-            object_id_type test_id = vehicle_node_map[node_id][i - 1].node_id;
-            Location test_location;
-            test_location = location_handler.get_node_location(test_id);
-            double angle_test = go.orientation(node_location, test_location);
-            if (angle_last < angle_test) {
-                swap(vehicle_node_map[node_id][i], vehicle_node_map[node_id][i - 1]);
-            } else {
-                break;
+    bool set_geometry(OGRFeature* feature, OGRLineString*& ogr_line,
+            Geometry* geometry) {
+
+        feature->SetFID(OGRNullFID);
+        if (go.fill_ogr_linestring(geometry, ogr_line)) {
+            return (feature->SetGeometryDirectly(ogr_line) == OGRERR_NONE);
+        }
+        OGRGeometry* ogr_geometry = go.geos2ogr(geometry);
+        return ogr_geometry &&
+                (feature->SetGeometryDirectly(ogr_geometry) == OGRERR_NONE);
+    }
+
+    void release_geometry(OGRFeature* feature, OGRLineString*& ogr_line) {
+        OGRGeometry* geometry = feature->StealGeometry();
+        if (geometry && (geometry != ogr_line)) {
+            OGRGeometryFactory::destroyGeometry(geometry);
+        }
+    }
+
+    void destroy_feature(OGRFeature* feature, OGRLineString* ogr_line) {
+        OGRFeature::DestroyFeature(feature);
+        OGRGeometryFactory::destroyGeometry(ogr_line);
+    }
+
+    /***
+     * Vertex id of a way end, a new vertex for a new coordinate.
+     */
+    int get_vertex_id(const Coordinate& coord) {
+        VertexKey key(coord);
+        auto vertex = vertex_ids.find(key);
+        if (vertex != vertex_ids.end()) {
+            vertex_counts[vertex->second - 1]++;
+            return vertex->second;
+        }
+        vertices.push_back(coord);
+        vertex_counts.push_back(1);
+        vertex_ids[key] = vertices.size();
+        return vertices.size();
+    }
+
+    /***
+     * Id of a sidewalk in the ways layer, a new one on the first call.
+     */
+    int get_sidewalk_way_id(Sidewalk* sidewalk) {
+        auto way_id = sidewalk_way_ids.find(sidewalk);
+        if (way_id != sidewalk_way_ids.end()) {
+            return way_id->second;
+        }
+        sidewalk_way_ids[sidewalk] = ++way_counter;
+        return way_counter;
+    }
+
+    /***
+     * Piece of a split sidewalk closest to coord, nullptr if there is
+     * none.
+     */
+    Sidewalk* get_closest_piece(const vector<Sidewalk*>& pieces,
+            const Coordinate& coord) {
+
+        Sidewalk* closest = nullptr;
+        double min_distance = numeric_limits<double>::infinity();
+        for (Sidewalk* piece : pieces) {
+            double distance = go.line_distance(
+                    dynamic_cast<LineString*>(piece->geometry), coord);
+            if (distance < min_distance) {
+                min_distance = distance;
+                closest = piece;
             }
         }
+        return closest;
+    }
+
+    /***
+     * Set the pgRouting columns of a way: source and target are the
+     * vertices of its ends, the cost is the length weighted by the type,
+     * see TagCheck::get_cost_factor. The ways can be walked in both
+     * directions.
+     */
+    void set_topology(OGRFeature* feature, Geometry* geometry, string type,
+            double length) {
+
+        LineString* linestring = dynamic_cast<LineString*>(geometry);
+        if (!linestring || linestring->isEmpty()) {
+            return;
+        }
+        int source = get_vertex_id(linestring->getCoordinateN(0));
+        int target = get_vertex_id(linestring->getCoordinateN(
+                linestring->getNumPoints() - 1));
+        double cost = length * TagCheck::get_cost_factor(type);
+        feature->SetField(field_source, source);
+        feature->SetField(field_target, target);
+        feature->SetField(field_cost, cost);
+        feature->SetField(field_reverse_cost, cost);
+    }
+
+    /***
+     * for the geometric creations of the sidewalks a clockwise order is
+     * neccessary. The neighbours are sorted by the pseudo-angle of their
+     * direction, equal directions keep the order of insertion.
+     */
+    void order_clockwise(object_id_type node_id,
+            vector<VehicleMapValue>& neighbours) {
+
+        if (neighbours.size() < 2) {
+            return;
+        }
+        Location node_location = location_handler.get_node_location(node_id);
+        vector<pair<double, size_t>> keys;
+        keys.reserve(neighbours.size());
+        for (size_t i = 0; i < neighbours.size(); ++i) {
+            Location neighbour_location = location_handler.get_node_location(
+                    neighbours[i].node_id);
+            keys.push_back(pair<double, size_t>(go.pseudo_angle(node_location,
+                    neighbour_location), i));
+        }
+        stable_sort(keys.begin(), keys.end(),
+                [](const pair<double, size_t>& a,
+                        const pair<double, size_t>& b) {
+            return a.first < b.first;
+        });
+        vector<VehicleMapValue> ordered;
+        ordered.reserve(neighbours.size());
+        for (auto key : keys) {
+            ordered.push_back(neighbours[key.second]);
+        }
+        neighbours.swap(ordered);
     }
         
 public:
@@ -211,9 +432,10 @@ public:
     google::sparse_hash_map<string, pair<Sidewalk*,
             Sidewalk*>> finished_segments;
 
-    geos::index::strtree::STRtree ortho_tree;
-    geos::index::strtree::STRtree sidewalk_tree;
-    geos::index::strtree::STRtree crossing_tree;
+    vector<Orthogonal*> orthos;
+    PackedRTree<size_t> ortho_index;    // positions in orthos, see Contrast
+    vector<CrossingPair*> crossing_pairs;
+    vector<Intersect> intersects;
     const bool is_foreward = true;
     const bool is_backward = false;
 
@@ -233,22 +455,70 @@ public:
         crossing_set.set_deleted_key(nullptr);
         //gid = 0;
         link_counter = 0;
+        way_counter = 0;
     }
 
     /***
      * creates the database tables when DataStorage object is destoyed.
      */
     ~DataStorage() {
+        close_db();
+        OGRCleanupAll();
+        for (GeometryFactory* factory : worker_factories) {
+            delete factory;
+        }
+    }
+
+    /***
+     * GEOS factory of the worker thread i. A factory is not thread safe, so
+     * each worker creates its geometries with its own one. The factories
+     * live as long as the DataStorage, so the geometries outlive the
+     * workers. Called before the workers start.
+     */
+    const GeometryFactory* get_worker_factory(size_t i) {
+        while (worker_factories.size() <= i) {
+            worker_factories.push_back(new GeometryFactory());
+        }
+        return worker_factories[i];
+    }
+
+    /***
+     * Write the tables and close the output.
+     */
+    void close_db() {
         layer_ways->CommitTransaction();
         /*layer_nodes->CommitTransaction();*/
         //layer_vehicle->CommitTransaction();
         //layer_sidewalks->CommitTransaction();
         //layer_crossings->CommitTransaction();
         layer_intersects->CommitTransaction();
+        layer_vertices->CommitTransaction();
         //layer_orthos->CommitTransaction();
 
         OGRDataSource::DestroyDataSource(data_source);
-        OGRCleanupAll();
+    }
+
+    /***
+     * Close the output and create the tables in a new one, e.g. for each
+     * parameter set of a sweep.
+     */
+    void reopen_db(string outfile) {
+        close_db();
+        output_filename = outfile;
+        init_db(psql);
+    }
+
+    /***
+     * Free the orthogonals and their index, they are only needed by the
+     * contrast.
+     */
+    void clear_orthos() {
+        for (Orthogonal* ortho : orthos) {
+            geometry_factory.destroyGeometry(ortho->line);
+            delete ortho;
+        }
+        orthos.clear();
+        ortho_index.clear();
     }
 
     /***
@@ -276,6 +546,17 @@ public:
         vehicle_node_map.clear();
         crossing_node_map.clear();
         finished_segments.clear();
+        clear_orthos();
+        for (CrossingPair* crossing_pair : crossing_pairs) {
+            delete crossing_pair;
+        }
+        crossing_pairs.clear();
+        intersects.clear();
+        way_counter = 0;
+        sidewalk_way_ids.clear();
+        vertex_ids.clear();
+        vertices.clear();
+        vertex_counts.clear();
     }
 
 
@@ -301,28 +582,31 @@ public:
 
 
     void insert_ways() {
+        OGRFeature* feature;
+        feature = OGRFeature::CreateFeature(layer_ways->GetLayerDefn());
+        OGRLineString* ogr_line = new OGRLineString();
         for (PedestrianRoad* road : pedestrian_road_set) {
             //gid++;
-            OGRFeature* feature;
-            feature = OGRFeature::CreateFeature(layer_ways->GetLayerDefn());
-
-            if (feature->SetGeometry(road->get_ogr_geom()) != OGRERR_NONE) {
+            if (!set_geometry(feature, ogr_line, road->geometry)) {
                 cerr << "Failed to create geometry feature for way: ";
                 cerr << road->osm_id << endl;
             }
 
             //feature->SetField("gid", gid);
+            feature->SetField(field_id, ++way_counter);
             feature->SetField("class_id", 1);
             feature->SetField("type", road->type.c_str());
             feature->SetField("length", road->length);
             feature->SetField("name", road->name.c_str());
             feature->SetField("osm_id", road->osm_id.c_str());
+            set_topology(feature, road->geometry, road->type, road->length);
 
             if (layer_ways->CreateFeature(feature) != OGRERR_NONE) {
                 cerr << "Failed to create ways feature." << endl;
             }
-            OGRFeature::DestroyFeature(feature);
+            release_geometry(feature, ogr_line);
         }
+        destroy_feature(feature, ogr_line);
     }
 
     /*void insert_vehicle() {
@@ -352,23 +636,46 @@ public:
         }
     }*/
  
-    //debug
-    void insert_intersect(Geometry* geometry, double length, double ratio) {
-        OGRFeature* feature;
-        feature = OGRFeature::CreateFeature(layer_intersects->GetLayerDefn());
-        
-        OGRGeometry* sidewalk = go.geos2ogr(geometry);
-        if (feature->SetGeometry(sidewalk) != OGRERR_NONE) {
-            cerr << "Failed to create geometry feature for intersects: ";
+    /***
+     * Keep a detected sidewalk for insert_intersects.
+     */
+    void store_intersect(Geometry* geometry, double length, double ratio) {
+        Intersect intersect;
+        const CoordinateSequence* coords = geometry->getCoordinatesRO();
+        intersect.coords.reserve(coords->getSize());
+        for (size_t i = 0; i < coords->getSize(); ++i) {
+            intersect.coords.push_back(coords->getAt(i));
         }
-        feature->SetField("length", length);
-        feature->SetField("ratio", ratio);
+        intersect.length = length;
+        intersect.ratio = ratio;
+        intersects.push_back(intersect);
+    }
 
-        if (layer_intersects->CreateFeature(feature) != OGRERR_NONE) {
-            cerr << "Failed to create ways feature." << endl;
+    /***
+     * Write the detected sidewalks into the layer intersects.
+     */
+    void insert_intersects() {
+        for (const Intersect& intersect : intersects) {
+            OGRFeature* feature;
+            feature = OGRFeature::CreateFeature(
+                    layer_intersects->GetLayerDefn());
+            OGRLineString sidewalk;
+            sidewalk.setNumPoints(intersect.coords.size());
+            for (size_t i = 0; i < intersect.coords.size(); ++i) {
+                sidewalk.setPoint(i, intersect.coords[i].x,
+                        intersect.coords[i].y);
+            }
+            if (feature->SetGeometry(&sidewalk) != OGRERR_NONE) {
+                cerr << "Failed to create geometry feature for intersects: ";
+            }
+            feature->SetField("length", intersect.length);
+            feature->SetField("ratio", intersect.ratio);
+
+            if (layer_intersects->CreateFeature(feature) != OGRERR_NONE) {
+                cerr << "Failed to create ways feature." << endl;
+            }
+            OGRFeature::DestroyFeature(feature);
         }
-        OGRFeature::DestroyFeature(feature);
-        OGRGeometryFactory::destroyGeometry(sidewalk);
     }
 
     /*void insert_orthos(Geometry* geometry) {
@@ -427,17 +734,17 @@ public:
             }
             OGRFeature::DestroyFeature(feature);
         }*/
+        OGRFeature* feature;
+        feature = OGRFeature::CreateFeature(layer_ways->GetLayerDefn());
+        OGRLineString* ogr_line = new OGRLineString();
         for (auto map_entry : sidewalk_map) {
             Sidewalk* sidewalk = map_entry.second;
             //gid++;
-            OGRFeature* feature;
-            feature = OGRFeature::CreateFeature(layer_ways->GetLayerDefn());
-
-            if (feature->SetGeometry(sidewalk->get_ogr_geom()) != OGRERR_NONE) {
+            if (!set_geometry(feature, ogr_line, sidewalk->geometry)) {
                 cerr << "Failed to create geometry feature for sidewalk: ";
             }
 
-            feature->SetField("id", sidewalk->id.c_str());
+            feature->SetField(field_id, get_sidewalk_way_id(sidewalk));
             //feature->SetField("gid", gid);
             feature->SetField("class_id", 1);
             feature->SetField("type", sidewalk->type.c_str());
@@ -445,55 +752,43 @@ public:
             feature->SetField("length", sidewalk->length);
             feature->SetField("name", sidewalk->name.c_str());
             //feature->SetField("osm_id", sidewalk->osm_id.c_str());
+            set_topology(feature, sidewalk->geometry, sidewalk->type,
+                    sidewalk->length);
 
 
 
             if (layer_ways->CreateFeature(feature) != OGRERR_NONE) {
                 cerr << "Failed to create ways feature." << endl;
             }
-            OGRFeature::DestroyFeature(feature);
+            release_geometry(feature, ogr_line);
         }/**/
-    }
-
-    void fill_sidewalk_tree() {
-        for (auto map_entry : sidewalk_map) {
-            Sidewalk* sidewalk = map_entry.second;
-            sidewalk_tree.insert(sidewalk->geometry->getEnvelopeInternal(), sidewalk);
-        }
-
-    }
-
-    void fill_crossing_tree() {
-        for (auto set_entry : crossing_set) {
-            Crossing* crossing = set_entry;
-            crossing_tree.insert(crossing->geometry->getEnvelopeInternal(), crossing);
-        }
-
+        destroy_feature(feature, ogr_line);
     }
 
     void insert_crossings() {
+        OGRFeature* feature;
+        feature = OGRFeature::CreateFeature(layer_ways->GetLayerDefn());
+        OGRLineString* ogr_line = new OGRLineString();
         for (Crossing* crossing : crossing_set) {
             //gid++;
-            OGRFeature* feature;
-            
-            feature = OGRFeature::CreateFeature(layer_ways->GetLayerDefn());
-
-            if (feature->SetGeometry(crossing->get_ogr_geom()) != OGRERR_NONE) {
+            if (!set_geometry(feature, ogr_line, crossing->geometry)) {
                 cerr << "Failed to create geometry feature for sidewalk: ";
             }
 
-            feature->SetField("id", crossing->id.c_str());
+            feature->SetField(field_id, ++way_counter);
             //feature->SetField("gid", gid);
             feature->SetField("class_id", 1);
             feature->SetField("type", crossing->type.c_str());
             feature->SetField("length", crossing->length);
             feature->SetField("name", crossing->name.c_str());
             //feature->SetField("osm_id", sidewalk->osm_id.c_str());
+            set_topology(feature, crossing->geometry, crossing->type,
+                    crossing->length);
 
             if (layer_ways->CreateFeature(feature) != OGRERR_NONE) {
                 cerr << "Failed to create ways feature." << endl;
             }
-            OGRFeature::DestroyFeature(feature);
+            release_geometry(feature, ogr_line);
             /*
             feature = OGRFeature::CreateFeature(layer_crossings->GetLayerDefn());
 
@@ -508,8 +803,100 @@ public:
             OGRFeature::DestroyFeature(feature);
             **/
         }
+        destroy_feature(feature, ogr_line);
+    }
+
+    /***
+     * Write the vertices of the inserted ways with their number of ways
+     * (cnt), like the vertices table of pgr_createTopology.
+     */
+    void insert_vertices() {
+        OGRFeature* feature;
+        feature = OGRFeature::CreateFeature(layer_vertices->GetLayerDefn());
+        for (size_t i = 0; i < vertices.size(); ++i) {
+            OGRPoint point(vertices[i].x, vertices[i].y);
+            feature->SetFID(OGRNullFID);
+            if (feature->SetGeometry(&point) != OGRERR_NONE) {
+                cerr << "Failed to create geometry feature for vertex: "
+                        << i + 1 << endl;
+            }
+            feature->SetField("id", static_cast<int>(i + 1));
+            feature->SetField("cnt", vertex_counts[i]);
+            if (layer_vertices->CreateFeature(feature) != OGRERR_NONE) {
+                cerr << "Failed to create vertices feature." << endl;
+            }
+        }
+        OGRFeature::DestroyFeature(feature);
     }
 
+    /***
+     * Write the lazy crossings into the layer crossing_pairs, one row per
+     * crossing without geometry. The sidewalks may be split after the
+     * crossing pairs were stored, so each end point is put on the closest
+     * piece of its sidewalk (the pieces keep the ID up to the index). An
+     * end is the id of the piece in the ways layer and the fraction of the
+     * piece up to the point, like the points of pgr_withPoints. So a
+     * consumer can add the crossings on demand to the topology of the
+     * ways, the cost is the length weighted by the type.
+     */
+    void insert_crossing_pairs() {
+        if (crossing_pairs.empty()) {
+            return;
+        }
+        create_table(layer_crossing_pairs, "crossing_pairs", wkbNone);
+        create_field(layer_crossing_pairs, "id", OFTInteger);
+        create_field(layer_crossing_pairs, "sidewalk", OFTInteger);
+        create_field(layer_crossing_pairs, "sw_frac", OFTReal);
+        create_field(layer_crossing_pairs, "neighbour", OFTInteger);
+        create_field(layer_crossing_pairs, "nb_frac", OFTReal);
+        create_field(layer_crossing_pairs, "type", OFTString, 20);
+        create_field(layer_crossing_pairs, "length", OFTReal);
+        create_field(layer_crossing_pairs, "cost", OFTReal);
+        google::sparse_hash_map<string, vector<Sidewalk*>> pieces;
+        for (auto map_entry : sidewalk_map) {
+            const string& id = map_entry.first;
+            pieces[id.substr(0, id.size() - PedroRoad::INDEX_DIGITS)]
+                    .push_back(map_entry.second);
+        }
+        OGRFeature* feature;
+        feature = OGRFeature::CreateFeature(
+                layer_crossing_pairs->GetLayerDefn());
+        int crossing_id = 0;
+        for (CrossingPair* crossing_pair : crossing_pairs) {
+            const string& sidewalk_id = crossing_pair->sidewalk_id;
+            const string& neighbour_id = crossing_pair->neighbour_id;
+            Sidewalk* sidewalk = get_closest_piece(pieces[sidewalk_id.substr(
+                    0, sidewalk_id.size() - PedroRoad::INDEX_DIGITS)],
+                    crossing_pair->sidewalk_point);
+            Sidewalk* neighbour = get_closest_piece(pieces[neighbour_id.substr(
+                    0, neighbour_id.size() - PedroRoad::INDEX_DIGITS)],
+                    crossing_pair->neighbour_point);
+            if (!sidewalk || !neighbour) {
+                continue;
+            }
+            double length = go.haversine(crossing_pair->sidewalk_point,
+                    crossing_pair->neighbour_point);
+            feature->SetFID(OGRNullFID);
+            feature->SetField("id", ++crossing_id);
+            feature->SetField("sidewalk", get_sidewalk_way_id(sidewalk));
+            feature->SetField("sw_frac", go.line_fraction(
+                    dynamic_cast<LineString*>(sidewalk->geometry),
+                    crossing_pair->sidewalk_point));
+            feature->SetField("neighbour", get_sidewalk_way_id(neighbour));
+            feature->SetField("nb_frac", go.line_fraction(
+                    dynamic_cast<LineString*>(neighbour->geometry),
+                    crossing_pair->neighbour_point));
+            feature->SetField("type", crossing_pair->type.c_str());
+            feature->SetField("length", length);
+            feature->SetField("cost", length *
+                    TagCheck::get_cost_factor(crossing_pair->type));
+
+            if (layer_crossing_pairs->CreateFeature(feature) != OGRERR_NONE) {
+                cerr << "Failed to create crossing_pairs feature." << endl;
+            }
+        }
+        OGRFeature::DestroyFeature(feature);
+    }
 
     void insert_in_vehicle_node_map(object_id_type start_node,
             object_id_type end_node, VehicleRoad* road, bool start_is_crossing,
@@ -540,11 +927,62 @@ public:
                 start_crossing_type);
         vehicle_node_map[start_node].push_back(foreward);
         vehicle_node_map[end_node].push_back(backward);
-        if (vehicle_node_map[start_node].size() > 1) {
-            order_clockwise(start_node);
+    }
+
+    /***
+     * Apply a profile to the ingestion of several profiles, see
+     * Profile::combine. The roads of the other profiles are removed and
+     * untagged vehicle roads get the default sidewalk of the profile.
+     */
+    void apply_profile(const Profile& profile) {
+        google::sparse_hash_set<VehicleRoad*> removed_vehicles;
+        for (VehicleRoad* road : vehicle_road_set) {
+            if (!profile.is_vehicle_type(road->type)) {
+                removed_vehicles.insert(road);
+            } else if (road->sidewalk == Profile::untagged_sidewalk) {
+                road->sidewalk = profile.default_sidewalk;
+            }
+        }
+        vector<object_id_type> empty_nodes;
+        for (auto& map_entry : vehicle_node_map) {
+            vector<VehicleMapValue>& neighbours = map_entry.second;
+            neighbours.erase(remove_if(neighbours.begin(), neighbours.end(),
+                    [&](const VehicleMapValue& value) {
+                return removed_vehicles.find(value.vehicle_road) !=
+                        removed_vehicles.end();
+            }), neighbours.end());
+            if (neighbours.empty()) {
+                empty_nodes.push_back(map_entry.first);
+            }
         }
-        if (vehicle_node_map[end_node].size() > 1) {
-            order_clockwise(end_node);
+        for (object_id_type node_id : empty_nodes) {
+            vehicle_node_map.erase(node_id);
+        }
+        for (VehicleRoad* road : removed_vehicles) {
+            vehicle_road_set.erase(road);
+            geometry_factory.destroyGeometry(road->geometry);
+            delete road;
+        }
+        vector<PedestrianRoad*> removed_pedestrians;
+        for (PedestrianRoad* road : pedestrian_road_set) {
+            if (!profile.is_pedestrian_type(road->type)) {
+                removed_pedestrians.push_back(road);
+            }
+        }
+        for (PedestrianRoad* road : removed_pedestrians) {
+            pedestrian_road_set.erase(road);
+            geometry_factory.destroyGeometry(road->geometry);
+            delete road;
+        }
+    }
+
+    /***
+     * Order the neighbours of every node clockwise. Called once after all
+     * ways are inserted into the vehicle_node_map.
+     */
+    void order_vehicle_node_map() {
+        for (auto& map_entry : vehicle_node_map) {
+            order_clockwise(map_entry.first, map_entry.second);
         }
     }
 };
@@ -14,8 +14,18 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <limits>
 #include <geos/geom/GeometryFactory.h>
 
+/***
+ * Results of GeomOperate::segment_intersection.
+ */
+enum SegmentIntersection {
+    no_intersection,
+    point_intersection,
+    collinear_intersection
+};
+
 struct LonLat {
     double lon;
     double lat;
@@ -26,24 +36,205 @@ struct LonLat {
     }
 };
 
+const double TO_RAD = (3.1415926536 / 180);
+const double TO_DEG = (180 / 3.1415926536);
+
+/***
+ * Local metric planes of the processed region. If they are enabled,
+ * distances and offsets are calculated with constant kilometer per degree
+ * factors instead of haversine and inverse haversine. Every latitude band
+ * of 0.01 degree (about 1 km) has its own plane with the factors of its
+ * center latitude, so the error does not grow with the size of the
+ * extract. The planes only depend on the latitude, a run resumed from a
+ * checkpoint uses the same ones. The geometries stay in WGS84, so no
+ * projection is needed for the output. Shared by all GeomOperate objects.
+ */
+struct LocalPlane {
+    const double band = 0.01;
+    bool enabled;
+    double km_per_lat;
+    vector<double> band_km_per_lon;
+
+    LocalPlane() :
+            enabled(false),
+            km_per_lat(6371 * TO_RAD) {
+        size_t num_bands = static_cast<size_t>(180 / band + 0.5);
+        band_km_per_lon.reserve(num_bands);
+        for (size_t i = 0; i < num_bands; ++i) {
+            double center = -90 + (i + 0.5) * band;
+            band_km_per_lon.push_back(km_per_lat * cos(center * TO_RAD));
+        }
+    }
+
+    static LocalPlane& get() {
+        static LocalPlane plane;
+        return plane;
+    }
+
+    /***
+     * Kilometer per degree longitude in the plane of the latitude.
+     */
+    double km_per_lon(double lat) const {
+        double position = (lat + 90) / band;
+        if (position <= 0) {
+            return band_km_per_lon.front();
+        }
+        size_t i = static_cast<size_t>(position);
+        return band_km_per_lon[min(i, band_km_per_lon.size() - 1)];
+    }
+
+    bool is_active() const {
+        return enabled;
+    }
+};
+
 class GeomOperate {
 
     const int EARTH_RADIUS = 6371;
     const int SQRT2 = 1.4142;
-    const double TO_RAD = (3.1415926536 / 180);
-    const double TO_DEG = (180 / 3.1415926536);
     OGRSpatialReference sparef_wgs84;
     OGRGeometryFactory ogr_factory;
     GeometryFactory geos_factory;
-    geos::io::WKTReader geos_wkt_reader;
+    const GeometryFactory* external_factory;  // see set_factory
     GEOSContextHandle_t hGEOSCtxt;
 
+    /* |latitude difference| and half chord (in radian) up to which the
+     * Taylor series of haversine_simd are exact in double precision */
+    const double TAYLOR_LIMIT = 0.01;
+
+    /***
+     * Segment i of haversine_batch.
+     */
+    double haversine_segment(const double* sin_lon, const double* cos_lon,
+            const double* lat, size_t i) {
+
+        double dlat = (lat[i] - lat[i + 1]) * TO_RAD;
+        double dz = sin_lon[i] - sin_lon[i + 1];
+        double dx = cos(dlat) * cos_lon[i] - cos_lon[i + 1];
+        double dy = sin(dlat) * cos_lon[i];
+        return asin(sqrt(dx * dx + dy * dy + dz * dz) / 2) * 2 * EARTH_RADIUS;
+    }
+
+#if SIMD_DOUBLE_WIDTH
+    /***
+     * SIMD_DOUBLE_WIDTH segments of haversine_batch from segment i on. The
+     * sine and cosine of the latitude difference and the arcsine are
+     * Taylor series, their truncation error is below the double rounding
+     * up to TAYLOR_LIMIT (about 60 km). Longer segments are calculated
+     * again by haversine_segment.
+     */
+    void haversine_simd(const double* sin_lon, const double* cos_lon,
+            const double* lat, size_t i, double* distances) {
+
+        SimdDouble dlat = (SimdDouble::load(lat + i) -
+                SimdDouble::load(lat + i + 1)) * SimdDouble(TO_RAD);
+        SimdDouble dlat2 = dlat * dlat;
+        SimdDouble sin_dlat = dlat * (SimdDouble(1.0) + dlat2 *
+                (SimdDouble(-1.0 / 6) + dlat2 * (SimdDouble(1.0 / 120) +
+                dlat2 * SimdDouble(-1.0 / 5040))));
+        SimdDouble cos_dlat = SimdDouble(1.0) + dlat2 *
+                (SimdDouble(-1.0 / 2) + dlat2 * (SimdDouble(1.0 / 24) +
+                dlat2 * (SimdDouble(-1.0 / 720) +
+                dlat2 * SimdDouble(1.0 / 40320))));
+        SimdDouble cos_lon1 = SimdDouble::load(cos_lon + i);
+        SimdDouble dz = SimdDouble::load(sin_lon + i) -
+                SimdDouble::load(sin_lon + i + 1);
+        SimdDouble dx = cos_dlat * cos_lon1 -
+                SimdDouble::load(cos_lon + i + 1);
+        SimdDouble dy = sin_dlat * cos_lon1;
+        SimdDouble h = (dx * dx + dy * dy + dz * dz).sqrt() *
+                SimdDouble(0.5);
+        SimdDouble h2 = h * h;
+        SimdDouble asin_h = h * (SimdDouble(1.0) + h2 *
+                (SimdDouble(1.0 / 6) + h2 * (SimdDouble(3.0 / 40) +
+                h2 * (SimdDouble(15.0 / 336) +
+                h2 * SimdDouble(105.0 / 3456)))));
+        (asin_h * SimdDouble(2.0 * EARTH_RADIUS)).store(distances + i);
+
+        double lane_dlat[SIMD_DOUBLE_WIDTH];
+        double lane_h[SIMD_DOUBLE_WIDTH];
+        dlat.store(lane_dlat);
+        h.store(lane_h);
+        for (size_t k = 0; k < SIMD_DOUBLE_WIDTH; ++k) {
+            if ((abs(lane_dlat[k]) > TAYLOR_LIMIT) ||
+                    (lane_h[k] > TAYLOR_LIMIT)) {
+                distances[i + k] = haversine_segment(sin_lon, cos_lon, lat,
+                        i + k);
+            }
+        }
+    }
+#endif
+
+    /***
+     * Join of the offset segments p1-p2 and q1-q2 at vertex, see
+     * parallel_polyline.
+     */
+    void add_miter(const Coordinate& p1, const Coordinate& p2,
+            const Coordinate& q1, const Coordinate& q2, Location vertex,
+            double distance, vector<Coordinate>& coords) {
+
+        Coordinate r(p2.x - p1.x, p2.y - p1.y);
+        Coordinate s(q2.x - q1.x, q2.y - q1.y);
+        double denominator = r.x * s.y - r.y * s.x;
+        if (denominator * denominator <= 1e-18 * (r.x * r.x + r.y * r.y) *
+                (s.x * s.x + s.y * s.y)) {
+            // (almost) collinear, both offset points are (almost) equal
+            coords.push_back(Coordinate((p2.x + q1.x) / 2,
+                    (p2.y + q1.y) / 2));
+            return;
+        }
+        double t = ((q1.x - p1.x) * s.y - (q1.y - p1.y) * s.x) / denominator;
+        Coordinate miter(p1.x + t * r.x, p1.y + t * r.y);
+        if (haversine(vertex.lon(), vertex.lat(), miter.x, miter.y) >
+                2 * distance) {
+            coords.push_back(p2);
+            coords.push_back(q1);
+        } else {
+            coords.push_back(miter);
+        }
+    }
+
+    /***
+     * Append the coordinate to a piece of split_line, unless it repeats the
+     * last one.
+     */
+    void add_coordinate(vector<Coordinate>* piece, const Coordinate& coord) {
+        if (!piece->back().equals2D(coord)) {
+            piece->push_back(coord);
+        }
+    }
+
+    /***
+     * LineString of a piece of split_line, takes the ownership of the
+     * vector. A single point is doubled to keep the LineString valid.
+     */
+    LineString* create_piece(vector<Coordinate>* piece) {
+        if (piece->size() == 1) {
+            piece->push_back(piece->back());
+        }
+        CoordinateSequence* coords = new CoordinateArraySequence(piece);
+        return get_factory().createLineString(coords);
+    }
+
+    const GeometryFactory& get_factory() const {
+        return external_factory ? *external_factory : geos_factory;
+    }
+
 public:
     
-    GeomOperate() {
+    GeomOperate() :
+            external_factory(nullptr) {
         sparef_wgs84.SetWellKnownGeogCS("WGS84");
         hGEOSCtxt = OGRGeometry::createGEOSContext();
-        geos_wkt_reader = geos::io::WKTReader(geos_factory);
+    }
+
+    /***
+     * Create the geometries with the given factory instead of the own one,
+     * e.g. with the factory of a worker thread, which outlives this
+     * GeomOperate. nullptr switches back.
+     */
+    void set_factory(const GeometryFactory* factory) {
+        external_factory = factory;
     }
 
     /***
@@ -52,6 +243,12 @@ public:
      */
     double haversine(double lon1, double lat1, double lon2, double lat2) {
 
+        LocalPlane& plane = LocalPlane::get();
+        if (plane.is_active()) {
+            double x = (lon2 - lon1) * plane.km_per_lon((lat1 + lat2) / 2);
+            double y = (lat2 - lat1) * plane.km_per_lat;
+            return sqrt(x * x + y * y);
+        }
         double dx, dy, dz;
         lat1 -= lat2;
         lat1 *= TO_RAD;
@@ -63,6 +260,94 @@ public:
         return asin(sqrt(dx * dx + dy * dy + dz * dz) / 2) * 2 * EARTH_RADIUS;
     }
 
+    /***
+     * Batch version of haversine for a line of n points. Writes the n - 1
+     * segment lengths into distances. The sine and cosine of every
+     * longitude are calculated once and shared by both adjacent segments.
+     * The segments are calculated SIMD_DOUBLE_WIDTH at a time by
+     * haversine_simd, the rest and builds without SIMD use the scalar
+     * loop. The results match haversine within 1e-9 km, see
+     * bench/haversine_check.
+     */
+    void haversine_batch(const double* lon, const double* lat, size_t n,
+            double* distances) {
+
+        if (n < 2) {
+            return;
+        }
+        size_t num_segments = n - 1;
+        size_t i = 0;
+        LocalPlane& plane = LocalPlane::get();
+        if (plane.is_active()) {
+#if SIMD_DOUBLE_WIDTH
+            SimdDouble km_per_lat(plane.km_per_lat);
+            double km_per_lon[SIMD_DOUBLE_WIDTH];
+            for (; i + SIMD_DOUBLE_WIDTH <= num_segments;
+                    i += SIMD_DOUBLE_WIDTH) {
+                for (size_t k = 0; k < SIMD_DOUBLE_WIDTH; ++k) {
+                    km_per_lon[k] = plane.km_per_lon(
+                            (lat[i + k] + lat[i + k + 1]) / 2);
+                }
+                SimdDouble x = (SimdDouble::load(lon + i + 1) -
+                        SimdDouble::load(lon + i)) *
+                        SimdDouble::load(km_per_lon);
+                SimdDouble y = (SimdDouble::load(lat + i + 1) -
+                        SimdDouble::load(lat + i)) * km_per_lat;
+                (x * x + y * y).sqrt().store(distances + i);
+            }
+#endif
+            for (; i < num_segments; ++i) {
+                double x = (lon[i + 1] - lon[i]) *
+                        plane.km_per_lon((lat[i] + lat[i + 1]) / 2);
+                double y = (lat[i + 1] - lat[i]) * plane.km_per_lat;
+                distances[i] = sqrt(x * x + y * y);
+            }
+            return;
+        }
+        // buffers of each thread, reused between calls
+        static thread_local vector<double> sin_lon_buffer;
+        static thread_local vector<double> cos_lon_buffer;
+        sin_lon_buffer.resize(n);
+        cos_lon_buffer.resize(n);
+        double* sin_lon = sin_lon_buffer.data();
+        double* cos_lon = cos_lon_buffer.data();
+        for (size_t j = 0; j < n; ++j) {
+            double rad = lon[j] * TO_RAD;
+            sin_lon[j] = sin(rad);
+            cos_lon[j] = cos(rad);
+        }
+#if SIMD_DOUBLE_WIDTH
+        for (; i + SIMD_DOUBLE_WIDTH <= num_segments;
+                i += SIMD_DOUBLE_WIDTH) {
+            haversine_simd(sin_lon, cos_lon, lat, i, distances);
+        }
+#endif
+        for (; i < num_segments; ++i) {
+            distances[i] = haversine_segment(sin_lon, cos_lon, lat, i);
+        }
+    }
+
+    /***
+     * Segment lengths of a coordinate sequence, see haversine_batch. The
+     * coordinates are copied into lon/lat arrays (structure of arrays).
+     */
+    void segment_lengths(const CoordinateSequence* coords,
+            vector<double>& lengths) {
+
+        static thread_local vector<double> lon;
+        static thread_local vector<double> lat;
+        size_t size = coords->getSize();
+        lon.resize(size);
+        lat.resize(size);
+        for (size_t i = 0; i < size; ++i) {
+            const Coordinate& coord = coords->getAt(i);
+            lon[i] = coord.x;
+            lat[i] = coord.y;
+        }
+        lengths.resize(size > 0 ? size - 1 : 0);
+        haversine_batch(lon.data(), lat.data(), size, lengths.data());
+    }
+
     double haversine(Point* point1, Point* point2) {
         
         double distance;
@@ -103,6 +388,20 @@ public:
         return max_lonlat;
     }
 
+    /***
+     * Z-order (morton) key of a location. Sorting by the key keeps nearby
+     * locations close together, e.g. to process nodes in spatial batches.
+     */
+    uint64_t spatial_key(Location location) {
+        uint64_t x = static_cast<uint32_t>(location.x()) ^ 0x80000000u;
+        uint64_t y = static_cast<uint32_t>(location.y()) ^ 0x80000000u;
+        uint64_t key = 0;
+        for (int i = 31; i >= 0; --i) {
+            key = (key << 2) | (((y >> i) & 1) << 1) | ((x >> i) & 1);
+        }
+        return key;
+    }
+
     double difference(double d1, double d2) {
         return (max(d1, d2) - min (d1, d2));
     }
@@ -137,6 +436,64 @@ public:
         return orientation;
     }
 
+
+    /***
+     * Pseudo-angle of the direction from one location to another, monotone
+     * in the orientation but without atan. The value is in [0, 4), each
+     * quadrant clockwise from north covers one unit.
+     */
+    double pseudo_angle(double lon1, double lat1, double lon2, double lat2) {
+        double dlon = difference(lon1, lon2);
+        double dlat = difference(lat1, lat2);
+        double sum = dlon + dlat;
+        if (sum == 0) {
+            return 0;
+        }
+        if (lat1 > lat2) {
+            if (lon1 < lon2) {
+                /* 2. Quadrant */
+                return 1 + dlat / sum;
+            }
+            /* 3. Quadrant */
+            return 2 + dlon / sum;
+        }
+        if (lon1 > lon2) {
+            /* 4. Quadrant */
+            return 3 + dlat / sum;
+        }
+        /* 1. Quadrant */
+        return dlon / sum;
+    }
+
+    double pseudo_angle(Location location1, Location location2) {
+        return pseudo_angle(location1.lon(), location1.lat(), location2.lon(),
+                location2.lat());
+    }
+
+    /***
+     * Vector from the start to the end point of a LineString, reversed if
+     * reverse is set.
+     */
+    Coordinate direction(const LineString* linestring, bool reverse = false) {
+        const CoordinateSequence* coords = linestring->getCoordinatesRO();
+        const Coordinate& start = coords->getAt(0);
+        const Coordinate& end = coords->getAt(coords->getSize() - 1);
+        double sign = reverse ? -1 : 1;
+        return Coordinate(sign * (end.x - start.x), sign * (end.y - start.y));
+    }
+
+    /***
+     * Positive if vector2 turns counterclockwise from vector1.
+     */
+    double cross_product(const Coordinate& vector1,
+            const Coordinate& vector2) {
+
+        return vector1.x * vector2.y - vector1.y * vector2.x;
+    }
+
+    double dot_product(const Coordinate& vector1, const Coordinate& vector2) {
+        return vector1.x * vector2.x + vector1.y * vector2.y;
+    }
         
     double orientation(Point* point1, Point* point2) {
         return orientation(point1->getX(), point1->getY(), point2->getX(),
@@ -186,9 +543,14 @@ public:
      * Calculate a vertical point from one lonlat pair to another on one side
      * with a giver distance.
      */
-    Point* vertical_point(double lon1, double lat1, double lon2,
+    Coordinate vertical_coordinate(double lon1, double lat1, double lon2,
             double lat2, double distance, bool left = true) {
 
+        LocalPlane& plane = LocalPlane::get();
+        if (plane.is_active()) {
+            return plane_vertical_coordinate(lon1, lat1, lon2, lat2, distance,
+                    left);
+        }
         int angle = 90;
         /*if (extend) {
             distance *= SQRT2;
@@ -204,32 +566,51 @@ public:
         }
         double new_lon = lon1 + sin(reverse_orientation * TO_RAD) * delta.lon;
         double new_lat = lat1 + cos(reverse_orientation * TO_RAD) * delta.lat;
-        const Coordinate coord = Coordinate(new_lon, new_lat);
-        Point* point = geos_factory.createPoint(coord);
+        return Coordinate(new_lon, new_lat);
+    }
+
+    Point* vertical_point(double lon1, double lat1, double lon2,
+            double lat2, double distance, bool left = true) {
+
+        const Coordinate coord = vertical_coordinate(lon1, lat1, lon2, lat2,
+                distance, left);
+        Point* point = get_factory().createPoint(coord);
         return point;
     }
 
+    /***
+     * vertical_coordinate in the LocalPlane: the direction is rotated by 90
+     * degrees in kilometers and scaled to the distance, only plain
+     * arithmetic is needed.
+     */
+    Coordinate plane_vertical_coordinate(double lon1, double lat1,
+            double lon2, double lat2, double distance, bool left = true) {
+
+        LocalPlane& plane = LocalPlane::get();
+        double km_per_lon = plane.km_per_lon(lat1);
+        double x = (lon2 - lon1) * km_per_lon;
+        double y = (lat2 - lat1) * plane.km_per_lat;
+        double length = sqrt(x * x + y * y);
+        if (length == 0) {
+            return Coordinate(lon1, lat1);
+        }
+        double factor = distance / length;
+        if (!left) {
+            factor = -factor;
+        }
+        double new_lon = lon1 - y * factor / km_per_lon;
+        double new_lat = lat1 + x * factor / plane.km_per_lat;
+        return Coordinate(new_lon, new_lat);
+    }
+
     Location vertical_location(double lon1, double lat1, double lon2,
             double lat2, double distance, bool left = true) {
 
-        int angle = 90;
-        /*if (extend) {
-            distance *= SQRT2;
-            angle = 45;
-        }*/
-        LonLat delta = inverse_haversine(lat1, distance);
-        double reverse_orientation;
-        reverse_orientation = orientation(lon1, lat1, lon2, lat2);
-        if (left) {
-            reverse_orientation -= angle;
-        } else {
-            reverse_orientation += angle;
-        }
+        Coordinate coord = vertical_coordinate(lon1, lat1, lon2, lat2,
+                distance, left);
         Location point;
-        double new_lon = lon1 + sin(reverse_orientation * TO_RAD) * delta.lon;
-        double new_lat = lat1 + cos(reverse_orientation * TO_RAD) * delta.lat;
-        point.set_lon(new_lon);
-        point.set_lat(new_lat);
+        point.set_lon(coord.x);
+        point.set_lat(coord.y);
         return point;
     }
 
@@ -263,13 +644,75 @@ public:
         return geos_line;
     }
 
+    /***
+     * Line parallel to the polyline of the locations. At an inner location
+     * the offset segments are joined at their intersection (miter). At
+     * sharp angles, where the miter would be further than twice the
+     * distance from the location, both offset points are kept (bevel).
+     * Repeated locations are skipped.
+     */
+    LineString* parallel_polyline(const vector<Location>& locations,
+            double distance, bool left = true) {
+
+        vector<Location> path;
+        path.reserve(locations.size());
+        for (const Location& location : locations) {
+            if (path.empty() || (location != path.back())) {
+                path.push_back(location);
+            }
+        }
+        if (path.size() < 3) {
+            return parallel_line(locations.front(), locations.back(),
+                    distance, left);
+        }
+        vector<Coordinate>* coord_v = new vector<Coordinate>();
+        coord_v->reserve(path.size() + 2);
+        Coordinate previous_start;
+        Coordinate previous_end;
+        for (size_t i = 0; i + 1 < path.size(); ++i) {
+            Location start = vertical_location(path[i], path[i + 1],
+                    distance, left);
+            Location end = vertical_location(path[i + 1], path[i],
+                    distance, !left);
+            Coordinate start_coord(start.lon(), start.lat());
+            Coordinate end_coord(end.lon(), end.lat());
+            if (i == 0) {
+                coord_v->push_back(start_coord);
+            } else {
+                add_miter(previous_start, previous_end, start_coord,
+                        end_coord, path[i], distance, *coord_v);
+            }
+            previous_start = start_coord;
+            previous_end = end_coord;
+        }
+        coord_v->push_back(previous_end);
+        CoordinateSequence* coords = new CoordinateArraySequence(coord_v);
+        return get_factory().createLineString(coords);
+    }
+
+    /***
+     * The first segment of the linestring, or the last one if at_end is
+     * set. The returned segment starts at the chosen end.
+     */
+    LineString* end_segment(const LineString* linestring, bool at_end) {
+        const CoordinateSequence* coords = linestring->getCoordinatesRO();
+        size_t size = coords->getSize();
+        if (at_end) {
+            return connect_coordinates(coords->getAt(size - 1),
+                    coords->getAt(size - 2));
+        }
+        return connect_coordinates(coords->getAt(0), coords->getAt(1));
+    }
+
     LineString* orthogonal_line(Point* point1, Point* point2, double distance) {
         LineString* ortho_line = nullptr;
-        Point* left_point = nullptr;
-        Point* right_point = nullptr;
-        left_point = vertical_point(point1, point2, distance, true);
-        right_point = vertical_point(point1, point2, distance, false);
-        ortho_line = connect_points(left_point, right_point);        
+        double lon1 = point1->getX();
+        double lat1 = point1->getY();
+        double lon2 = point2->getX();
+        double lat2 = point2->getY();
+        ortho_line = connect_coordinates(
+                vertical_coordinate(lon1, lat1, lon2, lat2, distance, true),
+                vertical_coordinate(lon1, lat1, lon2, lat2, distance, false));
         return ortho_line;
     }
 
@@ -281,31 +724,178 @@ public:
         const Coordinate* coordinate2;
         coordinate1 = point1->getCoordinate();
         coordinate2 = point2->getCoordinate();
+        return connect_coordinates(*coordinate1, *coordinate2);
+    }
+
+    /***
+     * Creates GEOS LineString of two Coordinates. The LineString takes the
+     * ownership of the coordinate sequence, nothing is copied.
+     */
+    LineString* connect_coordinates(const Coordinate& coordinate1,
+            const Coordinate& coordinate2) {
+
+        return connect_coordinates(coordinate1, coordinate2, get_factory());
+    }
+
+    /***
+     * Same with the given factory, for lines that outlive this GeomOperate.
+     */
+    LineString* connect_coordinates(const Coordinate& coordinate1,
+            const Coordinate& coordinate2, const GeometryFactory& factory) {
+
         vector<Coordinate>* coord_v = new vector<Coordinate>();
-        coord_v->push_back(*coordinate1);
-        coord_v->push_back(*coordinate2);
-        const CoordinateArraySequence coords = CoordinateArraySequence(coord_v);
-        return geos_factory.createLineString(coords);
+        coord_v->reserve(2);
+        coord_v->push_back(coordinate1);
+        coord_v->push_back(coordinate2);
+        CoordinateSequence* coords = new CoordinateArraySequence(coord_v);
+        return factory.createLineString(coords);
     }
 
     /***
      * Creates GEOS LineString of two osmium Locations.
      */
     LineString* connect_locations(Location location1, Location location2) {
-        Geometry* geos_line = nullptr;
-        string target_wkt = "LINESTRING (";
-        target_wkt += to_string(location1.lon()) + " ";
-        target_wkt += to_string(location1.lat()) + ", ";
-        target_wkt += to_string(location2.lon()) + " ";
-        target_wkt += to_string(location2.lat()) + ")";
-        const string wkt = target_wkt;
-        geos_line = geos_wkt_reader.read(wkt);
-        
-        if (!geos_line) {
-            cerr << "Failed to create from wkt.";
-            exit(1);
+        return connect_coordinates(Coordinate(location1.lon(),
+                location1.lat()), Coordinate(location2.lon(),
+                location2.lat()));
+    }
+
+    bool is_segment(const Geometry* geometry) {
+        return geometry->getNumPoints() == 2;
+    }
+
+    /***
+     * Intersection of the segments p1-p2 and q1-q2 without GEOS topology.
+     * The orientations are tested with the robust (double-double) predicate
+     * of GEOS. If the segments cross in one point, it is written to result.
+     * Collinear segments return collinear_intersection, the caller has to
+     * use GEOS for them.
+     */
+    int segment_intersection(const Coordinate& p1, const Coordinate& p2,
+            const Coordinate& q1, const Coordinate& q2, Coordinate& result) {
+
+        int o1 = geos::algorithm::CGAlgorithmsDD::orientationIndex(p1, p2, q1);
+        int o2 = geos::algorithm::CGAlgorithmsDD::orientationIndex(p1, p2, q2);
+        if (o1 * o2 > 0) {
+            return no_intersection;
+        }
+        int o3 = geos::algorithm::CGAlgorithmsDD::orientationIndex(q1, q2, p1);
+        int o4 = geos::algorithm::CGAlgorithmsDD::orientationIndex(q1, q2, p2);
+        if (o3 * o4 > 0) {
+            return no_intersection;
+        }
+        if ((o1 == 0) && (o2 == 0) && (o3 == 0) && (o4 == 0)) {
+            return collinear_intersection;
+        }
+        if (o1 == 0) {
+            result = q1;
+        } else if (o2 == 0) {
+            result = q2;
+        } else if (o3 == 0) {
+            result = p1;
+        } else if (o4 == 0) {
+            result = p2;
+        } else {
+            double px = p2.x - p1.x;
+            double py = p2.y - p1.y;
+            double qx = q2.x - q1.x;
+            double qy = q2.y - q1.y;
+            double t = ((q1.x - p1.x) * qy - (q1.y - p1.y) * qx) /
+                    (px * qy - py * qx);
+            result = Coordinate(p1.x + t * px, p1.y + t * py);
+        }
+        return point_intersection;
+    }
+
+    /***
+     * Overlap of the collinear segments p1-p2 and q1-q2, compared along the
+     * axis in which p1-p2 is longer: no_intersection if they are apart,
+     * point_intersection if they only touch (the point is written to
+     * coord), collinear_intersection if they overlap.
+     */
+    int collinear_overlap(const Coordinate& p1, const Coordinate& p2,
+            const Coordinate& q1, const Coordinate& q2, Coordinate& coord) {
+
+        bool along_x = abs(p2.x - p1.x) >= abs(p2.y - p1.y);
+        if ((p1.x == p2.x) && (p1.y == p2.y)) {
+            along_x = abs(q2.x - q1.x) >= abs(q2.y - q1.y);
+        }
+        auto value = [along_x](const Coordinate& c) {
+            return along_x ? c.x : c.y;
+        };
+        double low = max(min(value(p1), value(p2)),
+                min(value(q1), value(q2)));
+        double high = min(max(value(p1), value(p2)),
+                max(value(q1), value(q2)));
+        if (low > high) {
+            return no_intersection;
+        }
+        if (low < high) {
+            return collinear_intersection;
+        }
+        for (const Coordinate* end : {&p1, &p2, &q1, &q2}) {
+            if (value(*end) == low) {
+                coord = *end;
+                break;
+            }
+        }
+        return point_intersection;
+    }
+
+    /***
+     * Intersection points of two LineStrings by segment_intersection on
+     * every pair of their segments, no geometry is created. As in the
+     * MultiPoint of the GEOS intersection, the points are unique and
+     * sorted by x, then by y. Returns false if two segments overlap, the
+     * intersection is no set of points then.
+     */
+    bool line_intersections(const LineString* line1, const LineString* line2,
+            vector<Coordinate>& points) {
+
+        const CoordinateSequence* coords1 = line1->getCoordinatesRO();
+        const CoordinateSequence* coords2 = line2->getCoordinatesRO();
+        points.clear();
+        Coordinate point;
+        for (size_t i = 0; i + 1 < coords1->getSize(); ++i) {
+            for (size_t j = 0; j + 1 < coords2->getSize(); ++j) {
+                const Coordinate& p1 = coords1->getAt(i);
+                const Coordinate& p2 = coords1->getAt(i + 1);
+                const Coordinate& q1 = coords2->getAt(j);
+                const Coordinate& q2 = coords2->getAt(j + 1);
+                int result = segment_intersection(p1, p2, q1, q2, point);
+                if (result == collinear_intersection) {
+                    result = collinear_overlap(p1, p2, q1, q2, point);
+                }
+                if (result == collinear_intersection) {
+                    return false;
+                }
+                if (result == point_intersection) {
+                    points.push_back(point);
+                }
+            }
         }
-        return dynamic_cast<LineString*>(geos_line);
+        sort(points.begin(), points.end(),
+                [](const Coordinate& c1, const Coordinate& c2) {
+            return (c1.x < c2.x) || ((c1.x == c2.x) && (c1.y < c2.y));
+        });
+        points.erase(unique(points.begin(), points.end(),
+                [](const Coordinate& c1, const Coordinate& c2) {
+            return c1.equals2D(c2);
+        }), points.end());
+        return true;
+    }
+
+    /***
+     * segment_intersection of two LineStrings with two points each.
+     */
+    int segment_intersection(const Geometry* line1, const Geometry* line2,
+            Coordinate& result) {
+
+        const LineString* segment1 = dynamic_cast<const LineString*>(line1);
+        const LineString* segment2 = dynamic_cast<const LineString*>(line2);
+        return segment_intersection(segment1->getCoordinateN(0),
+                segment1->getCoordinateN(1), segment2->getCoordinateN(0),
+                segment2->getCoordinateN(1), result);
     }
 
     /***
@@ -336,25 +926,53 @@ public:
     LineString* insert_point(LineString*& segment, Geometry* point,
             bool at_end) {
 
+        return insert_point(segment,
+                *dynamic_cast<Point*>(point)->getCoordinate(), at_end);
+    }
+
+    LineString* insert_point(LineString*& segment,
+            const Coordinate& new_coordinate, bool at_end) {
+
         CoordinateSequence* coords;
         coords = segment->getCoordinates();
-        const Coordinate* new_coordinate;
-        new_coordinate = dynamic_cast<Point*>(point)->getCoordinate();
         int position = (at_end ? coords->getSize() : 0);
-        coords->add(position, *new_coordinate, true);
-        return geos_factory.createLineString(coords);
+        coords->add(position, new_coordinate, true);
+        return get_factory().createLineString(coords);
     }
 
     /***
      * Change the Point in segment at position to the given point.
      */
     LineString* set_point(LineString* segment, Geometry* point, int position) {
+        return set_point(segment,
+                *dynamic_cast<Point*>(point)->getCoordinate(), position);
+    }
+
+    LineString* set_point(LineString* segment,
+            const Coordinate& new_coordinate, int position) {
+
         CoordinateSequence* coords;
         coords = segment->getCoordinates();
-        const Coordinate *new_coordinate;
-        new_coordinate = dynamic_cast<Point*>(point)->getCoordinate();
-        coords->setAt(*new_coordinate, position);
-        return geos_factory.createLineString(coords);
+        coords->setAt(new_coordinate, position);
+        return get_factory().createLineString(coords);
+    }
+
+    LineString* set_point(LineString*& segment,
+            const Coordinate& new_coordinate, bool at_end) {
+
+        int position = (at_end ? segment->getNumPoints() - 1 : 0);
+        return set_point(segment, new_coordinate, position);
+    }
+
+    /***
+     * First coordinate of the linestring, or the last one if at_end is set.
+     * Unlike getStartPoint and getEndPoint no geometry is created.
+     */
+    const Coordinate& end_coordinate(const LineString* linestring,
+            bool at_end) {
+
+        const CoordinateSequence* coords = linestring->getCoordinatesRO();
+        return coords->getAt(at_end ? coords->getSize() - 1 : 0);
     }
 
 
@@ -386,37 +1004,187 @@ public:
         for (int i = 0; i < num_deletions; ++i) {
             coords->deleteAt(position);
         }
-        return geos_factory.createLineString(coords);
+        return get_factory().createLineString(coords);
+    }
+
+    /***
+     * Index of the segment of the LineString closest to the coordinate,
+     * e.g. of an intersection point, for split_line.
+     */
+    size_t closest_segment(const LineString* linestring,
+            const Coordinate& coord) {
+
+        const CoordinateSequence* coords = linestring->getCoordinatesRO();
+        size_t closest = 0;
+        double min_distance = numeric_limits<double>::infinity();
+        for (size_t i = 0; i + 1 < coords->getSize(); ++i) {
+            LineSegment segment(coords->getAt(i), coords->getAt(i + 1));
+            double distance = segment.distance(coord);
+            if (distance < min_distance) {
+                min_distance = distance;
+                closest = i;
+            }
+        }
+        return closest;
+    }
+
+    /***
+     * Distance (degrees) between the LineString and the coordinate.
+     */
+    double line_distance(const LineString* linestring,
+            const Coordinate& coord) {
+
+        const CoordinateSequence* coords = linestring->getCoordinatesRO();
+        double min_distance = numeric_limits<double>::infinity();
+        for (size_t i = 0; i + 1 < coords->getSize(); ++i) {
+            LineSegment segment(coords->getAt(i), coords->getAt(i + 1));
+            min_distance = min(min_distance, segment.distance(coord));
+        }
+        return min_distance;
+    }
+
+    /***
+     * Positions of the vertices (km from the start) of the segment lengths
+     * of segment_lengths.
+     */
+    void vertex_offsets(const vector<double>& lengths,
+            vector<double>& offsets) {
+
+        offsets.assign(1, 0);
+        for (double length : lengths) {
+            offsets.push_back(offsets.back() + length);
+        }
+    }
+
+    /***
+     * Position (km from the start of the line) of the point of the segment
+     * closest to coord. offsets and lengths are the vertex_offsets and the
+     * segment_lengths of coords.
+     */
+    double line_position(const CoordinateSequence* coords,
+            const vector<double>& offsets, const vector<double>& lengths,
+            size_t segment, const Coordinate& coord) {
+
+        if (lengths[segment] == 0) {
+            return offsets[segment];
+        }
+        LineSegment line_segment(coords->getAt(segment),
+                coords->getAt(segment + 1));
+        double factor = line_segment.projectionFactor(coord);
+        return offsets[segment] + max(0.0, min(1.0, factor)) *
+                lengths[segment];
+    }
+
+    /***
+     * Fraction of the length of the LineString up to the point closest to
+     * coord, like the fraction of a point on an edge in pgr_withPoints.
+     */
+    double line_fraction(const LineString* linestring,
+            const Coordinate& coord) {
+
+        const CoordinateSequence* coords = linestring->getCoordinatesRO();
+        if (coords->getSize() < 2) {
+            return 0;
+        }
+        vector<double> lengths;
+        vector<double> offsets;
+        segment_lengths(coords, lengths);
+        vertex_offsets(lengths, offsets);
+        if (offsets.back() == 0) {
+            return 0;
+        }
+        return line_position(coords, offsets, lengths,
+                closest_segment(linestring, coord), coord) / offsets.back();
+    }
+
+    /***
+     * Split a LineString at all split points in one pass. split_segments
+     * holds the index of the segment of each split point, the split points
+     * have to be sorted by their position along the line. There is always
+     * one piece more than split points, a split point at a vertex or at the
+     * start of the line gives a piece of two equal points. The lengths of
+     * the pieces are stored in lengths, full segments are taken from
+     * segment_lengths, only the split segments are calculated again.
+     */
+    vector<LineString*> split_line(const LineString* linestring,
+            const vector<Coordinate>& split_points,
+            const vector<size_t>& split_segments, vector<double>& lengths) {
+
+        const CoordinateSequence* coords = linestring->getCoordinatesRO();
+        static thread_local vector<double> split_segment_lengths;
+        segment_lengths(coords, split_segment_lengths);
+        size_t num_segments = split_segment_lengths.size();
+        vector<LineString*> pieces;
+        pieces.reserve(split_points.size() + 1);
+        lengths.clear();
+        lengths.reserve(split_points.size() + 1);
+        vector<Coordinate>* piece = new vector<Coordinate>();
+        piece->push_back(coords->getAt(0));
+        double piece_length = 0;
+        size_t split = 0;
+        for (size_t i = 0; i < num_segments; ++i) {
+            const Coordinate& start = coords->getAt(i);
+            const Coordinate& end = coords->getAt(i + 1);
+            bool is_split = false;
+            while ((split < split_points.size()) &&
+                    (split_segments[split] == i)) {
+                const Coordinate& split_point = split_points[split];
+                piece_length += haversine(piece->back(), split_point);
+                add_coordinate(piece, split_point);
+                pieces.push_back(create_piece(piece));
+                lengths.push_back(piece_length);
+                piece = new vector<Coordinate>();
+                piece->push_back(split_point);
+                piece_length = 0;
+                is_split = true;
+                split++;
+            }
+            if (is_split) {
+                piece_length += haversine(piece->back(), end);
+            } else {
+                piece_length += split_segment_lengths[i];
+            }
+            add_coordinate(piece, end);
+        }
+        pieces.push_back(create_piece(piece));
+        lengths.push_back(piece_length);
+        return pieces;
     }
 
     vector<Coordinate> segmentize(Coordinate start, Coordinate end,
             double fraction_length) {
 
         vector<Coordinate> splits;
-        LineSegment segment(start, end);
         double length = haversine(start.x, start.y, end.x, end.y);
+        segmentize(start, end, fraction_length, length, splits);
+        return splits;
+    }
+
+    /***
+     * Segmentize with an already known length (e.g. from segment_lengths).
+     * The split points are appended to splits. The points are interpolated
+     * directly instead of calling LineSegment::pointAlong for each one.
+     */
+    void segmentize(const Coordinate& start, const Coordinate& end,
+            double fraction_length, double length, vector<Coordinate>& splits) {
+
         double fraction = fraction_length / length;
+        double dx = end.x - start.x;
+        double dy = end.y - start.y;
         double position = 0;
         do {
-            Coordinate new_coord;
-            segment.pointAlong(position, new_coord);
-            splits.push_back(new_coord);
+            splits.push_back(Coordinate(start.x + position * dx,
+                    start.y + position * dy));
             position += fraction;
         } while (position < 1);
-        return splits;
     }
 
     OGRGeometry* ogr_connect_locations(Location location1, Location location2) {
-        OGRGeometry* ogr_line = nullptr;
-        string target_wkt = "LINESTRING (";
-        target_wkt += to_string(location1.lon()) + " "; target_wkt += to_string(location1.lat()) + ", ";
-        target_wkt += to_string(location2.lon()) + " ";
-        target_wkt += to_string(location2.lat()) + ")";
-        char* wkt;
-        wkt = strdup(target_wkt.c_str());
-        if (ogr_factory.createFromWkt(&wkt, &sparef_wgs84, &ogr_line) != OGRERR_NONE) {
-            cerr << "Failed to connect coordinates.";
-        }
+        OGRLineString* ogr_line = new OGRLineString();
+        ogr_line->setNumPoints(2);
+        ogr_line->setPoint(0, location1.lon(), location1.lat());
+        ogr_line->setPoint(1, location2.lon(), location2.lat());
+        ogr_line->assignSpatialReference(&sparef_wgs84);
         return ogr_line;
     }
 
@@ -439,7 +1207,7 @@ public:
         geos::geom::GeometryCollection* geom_collection = nullptr;
         Geometry* result = nullptr;
         try {
-            geom_collection = geos_factory.createGeometryCollection(
+            geom_collection = get_factory().createGeometryCollection(
                     &geom_vector);
         } catch (...) {
             cerr << "Failed to create geometry collection." << endl;
@@ -461,7 +1229,7 @@ public:
         double lon = ((point1->getX() + point2->getX()) / 2);
         double lat = ((point1->getY() + point2->getY()) / 2);
         Coordinate mean_coords(lon, lat);
-        Point* mean = geos_factory.createPoint(mean_coords);
+        Point* mean = get_factory().createPoint(mean_coords);
         return mean;
     }
 
@@ -483,61 +1251,14 @@ public:
         return geos_geom;
     }*/
 
-    /***
-     * NOT IN USE
-     * Some important intersections are missing, so the Geometries
-     * have to be extended. I've a losing pointer error if I use this.
-     */
-    Geometry* enlarge_line(Geometry*& geometry, double distance) {
-        CoordinateSequence* coords;
-        coords = geometry->getCoordinates();
-        size_t size = coords->size();
-        cout << "SIZE: " << size << endl;
-        const Coordinate front = coords->getAt(0);
-        const Coordinate second = coords->getAt(1);
-        const Coordinate back = coords->getAt(size - 1);
-        const Coordinate second_last = coords->getAt(size - 2);
-        cout << "SIZE: " << size << endl;
-
-        double dx = second.x - front.x;
-        double dy = second.y - front.y;
-        double x = sqrt(pow((dx), 2) /
-                        pow(dx, 2) + pow(dy, 2))
-                        * distance;
-        double y = sqrt(pow((dy), 2) /
-                        pow(dx, 2) + pow(dy, 2))
-                        * distance;
-        const Coordinate new_front(
-                (dx >= 0) ? front.x - x : front.x + x,
-                (dy >= 0) ? front.y - y : front.y + y);
-
-        dx = second_last.x - back.x;
-        dy = second_last.y - back.y;
-        x = sqrt(pow((dx), 2) /
-                 pow(dx, 2) + pow(dy, 2))
-                 * distance;
-        y = sqrt(pow((dy), 2) /
-                 pow(dx, 2) + pow(dy, 2))
-                 * distance;
-        const Coordinate new_back(
-                (dx >= 0) ? back.x - x : back.x + x,
-                (dy >= 0) ? back.y - y : back.y + y);
-                
-        coords->add(0, new_front, false);
-        coords->add(size, new_back, false);
-        return geos_factory.createLineString(coords);
-    }
-
     double get_length(Geometry *geometry) {
         double length = 0;
-        if (geometry->getGeometryType() == "LineString") {
+        if (geometry->getGeometryTypeId() == geos::geom::GEOS_LINESTRING) {
             LineString* linestring = dynamic_cast<LineString*>(geometry);
-            CoordinateSequence *coords;
-            coords = linestring->getCoordinates();
-            for (unsigned int i = 0; i < (coords->getSize() - 1); i++) {
-                Coordinate start = coords->getAt(i);
-                Coordinate end = coords->getAt(i + 1);
-                length += haversine(start.x, start.y, end.x, end.y);
+            static thread_local vector<double> lengths;
+            segment_lengths(linestring->getCoordinatesRO(), lengths);
+            for (double segment_length : lengths) {
+                length += segment_length;
             }
         } else {
             cerr << "error while get_length, geometry not LineString but "
@@ -547,10 +1268,41 @@ public:
         return length;
     }
 
+    /***
+     * Fill an existing OGRLineString with the coordinates of a GEOS
+     * LineString. The OGR point buffer is reused, if it is big enough.
+     * Returns false for other geometry types, use geos2ogr for them.
+     */
+    bool fill_ogr_linestring(const Geometry* g, OGRLineString* ogr_line) {
+        const LineString* linestring = dynamic_cast<const LineString*>(g);
+        if (!linestring) {
+            return false;
+        }
+        const CoordinateSequence* coords = linestring->getCoordinatesRO();
+        int num_points = coords->getSize();
+        ogr_line->setNumPoints(num_points, FALSE);
+        for (int i = 0; i < num_points; ++i) {
+            const Coordinate& coord = coords->getAt(i);
+            ogr_line->setPoint(i, coord.x, coord.y);
+        }
+        return true;
+    }
+
+    /***
+     * Convert a GEOS geometry to OGR. LineStrings are copied directly from
+     * the coordinate sequence, other types use WKB.
+     */
     OGRGeometry* geos2ogr(const Geometry* g)
     {
         OGRGeometry* ogr_geom;
 
+        if (g->getGeometryTypeId() == geos::geom::GEOS_LINESTRING) {
+            OGRLineString* ogr_line = new OGRLineString();
+            if (fill_ogr_linestring(g, ogr_line)) {
+                return ogr_line;
+            }
+            OGRGeometryFactory::destroyGeometry(ogr_line);
+        }
         geos::io::WKBWriter wkbWriter;
         wkbWriter.setOutputDimension(g->getCoordinateDimension());
         ostringstream ss;
@@ -31,156 +31,199 @@ class GeometryConstructor {
             temp_crossing_map;
     google::sparse_hash_map<string, vector<Sidewalk*>>
             temp_sidewalk_map;
-    GeometryFactory geos_factory;
+
+    /***
+     * State of one worker thread of the parallel sidewalk generation.
+     */
+    struct SidewalkWorker {
+        SidewalkFactory* sidewalk_factory;
+        CrossingFactory* crossing_factory;
+    };
+
+    /***
+     * Sidewalk segments around one node of the vehicle_node_map and the OSM
+     * crossings created there.
+     */
+    struct NodeSegments {
+        object_id_type node_id;
+        const vector<VehicleMapValue>* neighbours;
+        vector<Sidewalk*> segments;
+        vector<bool> reverse;
+        vector<Crossing*> crossings;
+    };
+
+    /***
+     * One split of connect_sidewalks_and_pedesrians: the pedestrian way at
+     * position of the pedestrians is split together with a sidewalk or a
+     * crossing at split_point, the pointer of the other kind is nullptr.
+     * The workers only find the split points and their segments, the
+     * pieces are created by merge_changes.
+     */
+    struct ConnectChange {
+        size_t position;
+        PedestrianRoad* pedestrian;
+        Sidewalk* sidewalk;
+        Crossing* crossing;
+        Coordinate split_point;
+        size_t pedestrian_segment;      // index of the split segments
+        size_t other_segment;
+        int count_intersects;
+
+        bool operator<(const ConnectChange& other) const {
+            return position < other.position;
+        }
+    };
+
+    /***
+     * State of one worker thread of connect_sidewalks_and_pedesrians. The
+     * workers share the geometries, so they only read their coordinates
+     * and do not create or operate on GEOS geometries. The changes are
+     * buffered per worker and merged in the order of the pedestrians
+     * afterwards.
+     */
+    struct ConnectWorker {
+        GeomOperate go;
+        size_t position;
+        vector<Coordinate> points;
+        vector<ConnectChange> changes;
+    };
 
     /***
      * A given geometry is split into a pair of geometries divided at a given
-     * point.
+     * point on the segment split_segment. The lengths of both pieces are
+     * stored in lengths.
      */
     pair<Geometry*, Geometry*> split_line(Geometry* geometry,
-            Point* split_point) {
-
-        LineString* origin_geometry = dynamic_cast<LineString*>(geometry);
-        LineString* first_segment = nullptr;
-        LineString* second_segment = nullptr;
-        int num_points = geometry->getNumPoints();
-        if (num_points == 2) {
-            first_segment = go.set_point(origin_geometry, split_point, true);
-            second_segment = go.set_point(origin_geometry, split_point, false);
-        } else {
-            for (int i = 0; i < num_points - 1; ++i) {
-                if (go.point_is_between(split_point,
-                        origin_geometry->getPointN(i),
-                        origin_geometry->getPointN(i + 1))) {
-                    first_segment = go.set_point(origin_geometry, split_point,
-                            i + 1);
-                    if ((i + 1) < (num_points - 1)) {
-                        first_segment = go.cut_line(first_segment, i + 1, true);
-                    }
-                    second_segment = go.set_point(origin_geometry, split_point,
-                            i);
-                    if (i > 0) {
-                        second_segment = go.cut_line(second_segment, i, false);
-                    }
-                    break;
-                }
-            }
-        }
-        if (first_segment) {
-            geometry = first_segment;
-        } else {
-            cerr << "unexcepted error in split_line / GeometryConstructor"
-                    << endl;
-            exit(1);
+            const Coordinate& split_point, size_t split_segment,
+            vector<double>& lengths) {
+
+        LineString* linestring = dynamic_cast<LineString*>(geometry);
+        vector<Coordinate> split_points(1, split_point);
+        vector<size_t> split_segments(1, split_segment);
+        vector<LineString*> pieces = go.split_line(linestring,
+                split_points, split_segments, lengths);
+        return pair<Geometry*, Geometry*>(pieces[0], pieces[1]);
+    }
+
+    /***
+     * Store the splits of the pedestrian way with a sidewalk or crossing
+     * (other_line). With several intersection points the pedestrian way is
+     * split at all but the last one, with the intersect count increased
+     * after each. Lines, that overlap, are not split.
+     */
+    void add_splits(ConnectWorker& worker, PedestrianRoad* pedestrian,
+            Sidewalk* sidewalk, Crossing* crossing,
+            const LineString* other_line, int& count_intersects) {
+
+        const LineString* pedestrian_line = dynamic_cast<LineString*>(
+                pedestrian->geometry);
+        if (!worker.go.line_intersections(pedestrian_line, other_line,
+                worker.points) || worker.points.empty()) {
+            return;
         }
-        if (!second_segment) {
-            cerr << "unexcepted error in split_line / GeometryConstructor"
-                    << endl;
-            exit(1);
+        count_intersects++;
+        bool is_multipoint = worker.points.size() > 1;
+        size_t num_splits = is_multipoint ? worker.points.size() - 1 : 1;
+        for (size_t i = 0; i < num_splits; ++i) {
+            const Coordinate& point = worker.points[i];
+            ConnectChange change = {worker.position, pedestrian, sidewalk,
+                    crossing, point,
+                    worker.go.closest_segment(pedestrian_line, point),
+                    worker.go.closest_segment(other_line, point),
+                    count_intersects};
+            worker.changes.push_back(change);
+            if (is_multipoint) {
+                count_intersects++;
+            }
         }
-        return pair<Geometry*, Geometry*>(first_segment, second_segment);
     }
 
     /***
-     * Split both, crossing and OSM pedestrian, and create new objects.
+     * Split both, sidewalk and OSM pedestrian, and create new objects.
      */
-    void split_and_create(PedestrianRoad* pedestrian, Crossing* crossing,
-            Point* intersection_point, int count_intersects) {
-
-        Geometry* pedestrian_g = pedestrian->geometry;
-        Geometry* crossing_g = crossing->geometry;
-        pair<Geometry*, Geometry*> pedestrian_pair =
-                split_line(pedestrian_g, intersection_point);
-        pair<Geometry*, Geometry*> crossing_pair =
-                split_line(crossing_g, intersection_point);
+    void split_and_create(const ConnectChange& change) {
+        PedestrianRoad* pedestrian = change.pedestrian;
+        vector<double> pedestrian_lengths;
+        pair<Geometry*, Geometry*> pedestrian_pair = split_line(
+                pedestrian->geometry, change.split_point,
+                change.pedestrian_segment, pedestrian_lengths);
         PedestrianRoad* changed_pedestrian = new PedestrianRoad(
-                pedestrian->get_index(), pedestrian, pedestrian_pair.first);
+                pedestrian->get_index(), pedestrian, pedestrian_pair.first,
+                pedestrian_lengths[0]);
         PedestrianRoad* new_pedestrian = new PedestrianRoad(
-                pedestrian->get_index() + count_intersects,
-                pedestrian, pedestrian_pair.second);
-        Crossing* changed_crossing = new Crossing(crossing, crossing_pair.first,
-                crossing->get_index());
-        Crossing* new_crossing = new Crossing(crossing, crossing_pair.second,
-                crossing->get_index() + count_intersects);
+                pedestrian->get_index() + change.count_intersects,
+                pedestrian, pedestrian_pair.second, pedestrian_lengths[1]);
         temp_pedestrian_map[pedestrian].push_back(changed_pedestrian);
         temp_pedestrian_set.insert(new_pedestrian);
-        temp_crossing_map[changed_crossing->id].push_back(changed_crossing);
-        temp_crossing_map["new"].push_back(new_crossing);
-    }
 
-    /***
-     * Iterate through multipoint and do split_and_create for each intersection
-     * point.
-     */
-    void split_and_create(PedestrianRoad* pedestrian, Crossing* crossing,
-            MultiPoint* multipoint, int count_intersects) {
-
-        CoordinateSequence *coords;
-        coords = multipoint->getCoordinates();
-        for (unsigned int i = 0; i < (coords->getSize() - 1); i++) {
-            Coordinate current = coords->getAt(i);
-            Point* intersection_point = geos_factory.createPoint(current);
-            split_and_create(pedestrian, crossing, intersection_point,
-                    count_intersects);
-            count_intersects++;
+        vector<double> other_lengths;
+        if (change.sidewalk) {
+            Sidewalk* sidewalk = change.sidewalk;
+            pair<Geometry*, Geometry*> sidewalk_pair = split_line(
+                    sidewalk->geometry, change.split_point,
+                    change.other_segment, other_lengths);
+            Sidewalk* changed_sidewalk = new Sidewalk(sidewalk,
+                    sidewalk_pair.first, sidewalk->get_index(),
+                    other_lengths[0]);
+            Sidewalk* new_sidewalk = new Sidewalk(sidewalk,
+                    sidewalk_pair.second,
+                    sidewalk->get_index() + change.count_intersects,
+                    other_lengths[1]);
+            temp_sidewalk_map[changed_sidewalk->id].push_back(
+                    changed_sidewalk);
+            temp_sidewalk_map["new"].push_back(new_sidewalk);
+        } else {
+            Crossing* crossing = change.crossing;
+            pair<Geometry*, Geometry*> crossing_pair = split_line(
+                    crossing->geometry, change.split_point,
+                    change.other_segment, other_lengths);
+            Crossing* changed_crossing = new Crossing(crossing,
+                    crossing_pair.first, crossing->get_index(),
+                    other_lengths[0]);
+            Crossing* new_crossing = new Crossing(crossing,
+                    crossing_pair.second,
+                    crossing->get_index() + change.count_intersects,
+                    other_lengths[1]);
+            temp_crossing_map[changed_crossing->id].push_back(
+                    changed_crossing);
+            temp_crossing_map["new"].push_back(new_crossing);
         }
     }
 
     /***
-     * Split both, sidewalk and OSM pedestrian, and create new objects.
+     * Merge the changes of the workers in the order of the pedestrians and
+     * create the pieces, so the temporary maps are filled as in a serial
+     * run. The pieces are created serially with the factory of the
+     * DataStorage.
      */
-    void split_and_create(PedestrianRoad* pedestrian, Sidewalk* sidewalk,
-            Point* intersection_point, int count_intersects) {
-
-        Geometry* pedestrian_g = pedestrian->geometry;
-        Geometry* sidewalk_g = sidewalk->geometry;
-        pair<Geometry*, Geometry*> pedestrian_pair =
-                split_line(pedestrian_g, intersection_point);
-        pair<Geometry*, Geometry*> sidewalk_pair =
-                split_line(sidewalk_g, intersection_point);
-        PedestrianRoad* changed_pedestrian = new PedestrianRoad(
-                pedestrian->get_index(), pedestrian, pedestrian_pair.first);
-        PedestrianRoad* new_pedestrian = new PedestrianRoad(
-                pedestrian->get_index() + count_intersects,
-                pedestrian, pedestrian_pair.second);
-        Sidewalk* changed_sidewalk = new Sidewalk(sidewalk, sidewalk_pair.first,
-                sidewalk->get_index());
-        Sidewalk* new_sidewalk = new Sidewalk(sidewalk, sidewalk_pair.second,
-                sidewalk->get_index() + count_intersects);
-        //debug
-        if (changed_pedestrian->osm_id == "23093185") {
-            cout << "DEBUG1" << endl;
-            cout << changed_pedestrian->geometry->toString() << endl;
-            cout << new_pedestrian->geometry->toString() << endl;
+    void merge_changes(vector<ConnectWorker>& workers) {
+        vector<ConnectChange> changes;
+        for (ConnectWorker& worker : workers) {
+            changes.insert(changes.end(), worker.changes.begin(),
+                    worker.changes.end());
         }
-        if (new_pedestrian->osm_id == "23093185") {
-            cout << "DEBUG2" << endl;
-            cout << changed_sidewalk->geometry->toString() << endl;
-            cout << new_sidewalk->geometry->toString() << endl;
+        /* the changes of one pedestrian are all buffered by one worker */
+        stable_sort(changes.begin(), changes.end());
+        for (const ConnectChange& change : changes) {
+            split_and_create(change);
         }
-
-        temp_pedestrian_map[pedestrian].push_back(changed_pedestrian);
-        temp_pedestrian_set.insert(new_pedestrian);
-        temp_sidewalk_map[changed_sidewalk->id].push_back(changed_sidewalk);
-        temp_sidewalk_map["new"].push_back(new_sidewalk);
     }
 
     /***
-     * Iterate through multipoint and do split_and_create for each intersection
-     * point.
+     * Begin of the pairs of each left position in the sorted pairs, the
+     * pairs of position p are [begins[p], begins[p + 1]).
      */
-    void split_and_create(PedestrianRoad* pedestrian, Sidewalk* sidewalk,
-            MultiPoint* multipoint, int count_intersects) {
-
-        CoordinateSequence *coords;
-        coords = multipoint->getCoordinates();
-        for (unsigned int i = 0; i < (coords->getSize() - 1); i++) {
-            Coordinate current = coords->getAt(i);
-            Point* intersection_point = geos_factory.createPoint(current);
-            split_and_create(pedestrian, sidewalk, intersection_point,
-                    count_intersects);
-            count_intersects++;
+    vector<size_t> get_group_begins(const vector<join_pair_type>& pairs,
+            size_t count) {
+
+        vector<size_t> begins(count + 1, 0);
+        for (const join_pair_type& join_pair : pairs) {
+            begins[join_pair.first + 1]++;
+        }
+        for (size_t p = 0; p < count; ++p) {
+            begins[p + 1] += begins[p];
         }
+        return begins;
     }
 
     /***
@@ -214,6 +257,193 @@ class GeometryConstructor {
         }
     }
 
+    /***
+     * Connect the sidewalk segments around one node and create the OSM
+     * crossing.
+     */
+    void connect_node_sidewalks(SidewalkFactory* sidewalk_factory,
+            CrossingFactory* crossing_factory,
+            const vector<VehicleMapValue>& neighbours,
+            vector<Sidewalk*>& segments, vector<bool>& reverse) {
+
+        sidewalk_factory->generate_connections(segments, reverse);
+        if (neighbours[0].is_crossing) {
+            string crossing_type = neighbours[0].crossing_type;
+            crossing_factory->generate_osm_crossing(segments, reverse,
+            crossing_type);
+        }
+    }
+
+    /***
+     * Create the sidewalks and the OSM crossing around one node of the
+     * vehicle_node_map.
+     */
+    void generate_node_sidewalks(SidewalkFactory* sidewalk_factory,
+            CrossingFactory* crossing_factory, object_id_type node_id,
+            vector<VehicleMapValue>& neighbours) {
+
+        vector<Sidewalk*> segments;
+        vector<bool> reverse;
+        sidewalk_factory->generate_parallel_segments(node_id,
+                neighbours, segments, reverse);
+        connect_node_sidewalks(sidewalk_factory, crossing_factory,
+                neighbours, segments, reverse);
+    }
+
+    /***
+     * Group the nodes for the connections. A sidewalk is changed by the
+     * nodes at both ends, so a node has to wait for the nodes coming
+     * earlier in the serial order, which share a sidewalk with it. The
+     * level of a node is one more than the highest level of these nodes.
+     * Nodes of one level have no common sidewalk.
+     */
+    vector<vector<size_t>> get_levels(const vector<NodeSegments>& nodes) {
+        google::sparse_hash_map<Sidewalk*, size_t> sidewalk_levels;
+        vector<vector<size_t>> levels;
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            size_t level = 0;
+            for (Sidewalk* sidewalk : nodes[i].segments) {
+                auto sidewalk_level = sidewalk_levels.find(sidewalk);
+                if (sidewalk_level != sidewalk_levels.end()) {
+                    level = max(level, sidewalk_level->second + 1);
+                }
+            }
+            for (Sidewalk* sidewalk : nodes[i].segments) {
+                if (sidewalk) {
+                    sidewalk_levels[sidewalk] = level;
+                }
+            }
+            if (levels.size() <= level) {
+                levels.resize(level + 1);
+            }
+            levels[level].push_back(i);
+        }
+        return levels;
+    }
+
+    /***
+     * A chain node connects exactly two nodes of the same VehicleRoad and
+     * is no crossing, so the sidewalks pass through it.
+     */
+    bool is_chain_node(const vector<VehicleMapValue>& neighbours) {
+        return (neighbours.size() == 2) &&
+                (neighbours[0].node_id != neighbours[1].node_id) &&
+                (neighbours[0].vehicle_road == neighbours[1].vehicle_road) &&
+                (neighbours[0].is_foreward != neighbours[1].is_foreward) &&
+                !neighbours[0].is_crossing && !neighbours[1].is_crossing;
+    }
+
+    /***
+     * Find the chain nodes of the vehicle_node_map. In a closed ring of
+     * chain nodes one node stays a normal node, where the ring starts and
+     * ends.
+     */
+    void find_chain_nodes(google::sparse_hash_set<object_id_type>&
+            chain_nodes) {
+
+        for (auto node : ds.vehicle_node_map) {
+            if (is_chain_node(node.second)) {
+                chain_nodes.insert(node.first);
+            }
+        }
+        google::sparse_hash_set<object_id_type> visited;
+        for (auto node : ds.vehicle_node_map) {
+            object_id_type start = node.first;
+            if ((chain_nodes.find(start) == chain_nodes.end()) ||
+                    (visited.find(start) != visited.end())) {
+                continue;
+            }
+            visited.insert(start);
+            for (const VehicleMapValue& first : node.second) {
+                object_id_type previous = start;
+                object_id_type current = first.node_id;
+                while ((current != start) &&
+                        (chain_nodes.find(current) != chain_nodes.end())) {
+                    visited.insert(current);
+                    const vector<VehicleMapValue>& neighbours =
+                            ds.vehicle_node_map[current];
+                    object_id_type next = (neighbours[0].node_id ==
+                            previous) ? neighbours[1].node_id :
+                            neighbours[0].node_id;
+                    previous = current;
+                    current = next;
+                }
+                if (current == start) {
+                    chain_nodes.erase(start);
+                    break;
+                }
+            }
+        }
+    }
+
+    /***
+     * Parallel version of generate_sidewalks with the same result as the
+     * serial run over node_ids:
+     *   1. The sidewalk objects are created serially without geometry, so
+     *      IDs, owners of shared segments (the node coming first) and the
+     *      finished_segments are the same.
+     *   2. The parallel lines are constructed by the workers.
+     *   3. The segments are connected by the workers level by level, see
+     *      get_levels. The OSM crossings are buffered per node and
+     *      inserted in the serial order.
+     * A segment may be constructed by another worker, so the workers only
+     * read the coordinates of the segments and create the geometries with
+     * their own factory of the DataStorage.
+     */
+    void generate_sidewalks_parallel(const vector<object_id_type>& node_ids,
+            unsigned int num_threads,
+            const google::sparse_hash_set<object_id_type>* chain_nodes) {
+
+        vector<NodeSegments> nodes(node_ids.size());
+        vector<DeferredSegment> deferred;
+        SidewalkFactory planner(ds, location_handler);
+        planner.set_deferred_segments(&deferred);
+        planner.set_chain_nodes(chain_nodes);
+        for (size_t i = 0; i < node_ids.size(); ++i) {
+            NodeSegments& node = nodes[i];
+            node.node_id = node_ids[i];
+            node.neighbours = &ds.vehicle_node_map[node.node_id];
+            planner.generate_parallel_segments(node.node_id,
+                    *node.neighbours, node.segments, node.reverse);
+        }
+
+        vector<SidewalkWorker> workers(num_threads);
+        for (size_t i = 0; i < workers.size(); ++i) {
+            SidewalkWorker& worker = workers[i];
+            worker.sidewalk_factory = new SidewalkFactory(ds,
+                    location_handler);
+            worker.sidewalk_factory->set_chain_nodes(chain_nodes);
+            worker.sidewalk_factory->set_factory(ds.get_worker_factory(i));
+            worker.crossing_factory = new CrossingFactory(ds,
+                    location_handler);
+            worker.crossing_factory->set_factory(ds.get_worker_factory(i));
+        }
+        run_parallel<SidewalkWorker>(workers, deferred.size(),
+                [&](SidewalkWorker& worker, size_t i) {
+            worker.sidewalk_factory->construct_deferred_segment(deferred[i]);
+        });
+        for (const vector<size_t>& level : get_levels(nodes)) {
+            run_parallel<SidewalkWorker>(workers, level.size(),
+                    [&](SidewalkWorker& worker, size_t i) {
+                NodeSegments& node = nodes[level[i]];
+                worker.crossing_factory->set_crossing_buffer(
+                        &node.crossings);
+                connect_node_sidewalks(worker.sidewalk_factory,
+                        worker.crossing_factory, *node.neighbours,
+                        node.segments, node.reverse);
+            });
+        }
+        for (NodeSegments& node : nodes) {
+            for (Crossing* crossing : node.crossings) {
+                ds.crossing_set.insert(crossing);
+            }
+        }
+        for (SidewalkWorker& worker : workers) {
+            delete worker.sidewalk_factory;
+            delete worker.crossing_factory;
+        }
+    }
+
 public:
 
     //OGRGeometry *test;
@@ -222,101 +452,174 @@ public:
             location_handler_type& location_handler) :
             ds(data_storage), location_handler(location_handler) {
 
+        /* the pieces of connect_sidewalks_and_pedesrians stay in the
+         * DataStorage */
+        go.set_factory(&ds.geometry_factory);
         PedestrianRoad* null_road;
         temp_pedestrian_map.set_deleted_key(null_road);
         temp_sidewalk_map.set_deleted_key("");
     }
 
+    /***
+     * Node ids of the vehicle_node_map sorted by their spatial key. Nodes
+     * close together are processed together, so the pages of a disk based
+     * location index are reused.
+     */
+    vector<object_id_type> get_spatial_order() {
+        vector<pair<uint64_t, object_id_type>> keys;
+        keys.reserve(ds.vehicle_node_map.size());
+        for (auto node : ds.vehicle_node_map) {
+            Location location = location_handler.get_node_location(
+                    node.first);
+            keys.push_back(pair<uint64_t, object_id_type>(
+                    go.spatial_key(location), node.first));
+        }
+        sort(keys.begin(), keys.end());
+        vector<object_id_type> node_ids;
+        node_ids.reserve(keys.size());
+        for (auto key : keys) {
+            node_ids.push_back(key.second);
+        }
+        return node_ids;
+    }
+
     /***
      * Iterate through vehicle_node_map and create sidewalk geometries.
      * Use the intern SidewalkFactory and CrossingFactory.
+     * If spatial_order is set, the nodes are processed in spatially sorted
+     * batches (node file, -m). With more than one thread the result is
+     * the same, see generate_sidewalks_parallel. If chains is set, the
+     * roads are contracted over the chain nodes and the chain nodes are
+     * skipped.
      */
-    void generate_sidewalks() {
+    void generate_sidewalks(bool spatial_order = false,
+            unsigned int num_threads = 1, bool chains = false) {
+
+        google::sparse_hash_set<object_id_type> chain_nodes;
+        chain_nodes.set_deleted_key(-1);
+        if (chains) {
+            find_chain_nodes(chain_nodes);
+        }
+        vector<object_id_type> node_ids;
+        if (spatial_order) {
+            node_ids = get_spatial_order();
+        } else {
+            node_ids.reserve(ds.vehicle_node_map.size());
+            for (auto node : ds.vehicle_node_map) {
+                node_ids.push_back(node.first);
+            }
+        }
+        if (chains) {
+            size_t kept = 0;
+            for (object_id_type node_id : node_ids) {
+                if (chain_nodes.find(node_id) == chain_nodes.end()) {
+                    node_ids[kept++] = node_id;
+                }
+            }
+            node_ids.resize(kept);
+        }
+        if (num_threads > 1) {
+            generate_sidewalks_parallel(node_ids, num_threads,
+                    chains ? &chain_nodes : nullptr);
+            return;
+        }
         SidewalkFactory* sidewalk_factory = new SidewalkFactory(ds,
                 location_handler);
         CrossingFactory* crossing_factory = new CrossingFactory(ds,
                 location_handler);
-        vector<Sidewalk*> segments;
-        vector<bool> reverse;
-        for (auto node : ds.vehicle_node_map) {
-            segments.clear();
-            reverse.clear();
-            sidewalk_factory->generate_parallel_segments(node.first,
-                    node.second, segments, reverse);
-            sidewalk_factory->generate_connections(segments, reverse);
-            if (node.second[0].is_crossing) {
-                string crossing_type = node.second[0].crossing_type;
-                crossing_factory->generate_osm_crossing(segments, reverse,
-                crossing_type);
-            }
+        sidewalk_factory->set_factory(ds.get_worker_factory(0));
+        crossing_factory->set_factory(ds.get_worker_factory(0));
+        if (chains) {
+            sidewalk_factory->set_chain_nodes(&chain_nodes);
+        }
+        for (object_id_type node_id : node_ids) {
+            generate_node_sidewalks(sidewalk_factory, crossing_factory,
+                    node_id, ds.vehicle_node_map[node_id]);
         }
+        delete sidewalk_factory;
+        delete crossing_factory;
+    }
+
+    /***
+     * Envelopes of the roads for the SpatialJoin.
+     */
+    template <typename TRoad>
+    vector<const Envelope*> get_envelopes(const vector<TRoad*>& roads) {
+        vector<const Envelope*> envelopes;
+        envelopes.reserve(roads.size());
+        for (TRoad* road : roads) {
+            envelopes.push_back(road->geometry->getEnvelopeInternal());
+        }
+        return envelopes;
     }
 
     /***
      * Connect the original OSM pedestrian ways with the constructed
-     * geometries. Iterate over pedestrian ways and query the sidewalk_tree.
-     * The results are intersected with the way and split_and_create is called
-     * for every positive intersection.
+     * geometries. The pedestrian ways are joined with the sidewalks and the
+     * crossings in one batch each. The workers intersect the candidates
+     * with the way on their coordinates and store the split points, see
+     * add_splits. The changes are merged in the order of the pedestrian
+     * ways and split_and_create creates the pieces serially, so the result
+     * does not depend on num_threads.
      */
-    void connect_sidewalks_and_pedesrians() {
-        for (PedestrianRoad* pedestrian : ds.pedestrian_road_set) {
-            Geometry* pedestrian_g = pedestrian->geometry;
-            /***ENLARGING LINESTRING NOT IMPLEMENTED JET***
-            cout << "before: " << pedestrian_g->toString() << endl;
-            pedestrian_g = go.enlarge_line(pedestrian_g, 0.001);
-            cout << "after: " << pedestrian_g->toString() << endl;
-            ***/
-            vector<void *> results_sidewalk;
-            ds.sidewalk_tree.query(pedestrian_g->getEnvelopeInternal(), results_sidewalk);
-            if (results_sidewalk.size() > 1) {
+    void connect_sidewalks_and_pedesrians(unsigned int num_threads = 1) {
+        vector<PedestrianRoad*> pedestrians(ds.pedestrian_road_set.begin(),
+                ds.pedestrian_road_set.end());
+        vector<Sidewalk*> sidewalks;
+        sidewalks.reserve(ds.sidewalk_map.size());
+        for (auto map_entry : ds.sidewalk_map) {
+            sidewalks.push_back(map_entry.second);
+        }
+        vector<Crossing*> crossings(ds.crossing_set.begin(),
+                ds.crossing_set.end());
+        vector<const Envelope*> pedestrian_envelopes =
+                get_envelopes(pedestrians);
+        vector<join_pair_type> sidewalk_pairs;
+        vector<join_pair_type> crossing_pairs;
+        SpatialJoin spatial_join(num_threads);
+        spatial_join.join(pedestrian_envelopes, get_envelopes(sidewalks),
+                sidewalk_pairs);
+        spatial_join.join(pedestrian_envelopes, get_envelopes(crossings),
+                crossing_pairs);
+        vector<size_t> sidewalk_begins = get_group_begins(sidewalk_pairs,
+                pedestrians.size());
+        vector<size_t> crossing_begins = get_group_begins(crossing_pairs,
+                pedestrians.size());
+
+        vector<ConnectWorker> workers(num_threads);
+        run_parallel<ConnectWorker>(workers, pedestrians.size(),
+                [&](ConnectWorker& worker, size_t p) {
+            size_t sidewalk_begin = sidewalk_begins[p];
+            size_t sidewalk_end = sidewalk_begins[p + 1];
+            size_t crossing_begin = crossing_begins[p];
+            size_t crossing_end = crossing_begins[p + 1];
+            bool has_sidewalks = (sidewalk_end - sidewalk_begin) > 1;
+            bool has_crossings = (crossing_end - crossing_begin) > 1;
+            if (!has_sidewalks && !has_crossings) {
+                return;
+            }
+            worker.position = p;
+            PedestrianRoad* pedestrian = pedestrians[p];
+            if (has_sidewalks) {
                 int count_intersects = 0;
-                Sidewalk* sidewalk = nullptr;
-                for (auto result : results_sidewalk) {
-                    sidewalk = static_cast<Sidewalk*>(result);
-                    Geometry* sidewalk_g = sidewalk->geometry;
-                    if (pedestrian_g->intersects(const_cast<const Geometry*>(sidewalk_g))) {
-                        count_intersects++;
-                        Geometry* intersection = pedestrian_g->intersection(
-                                const_cast<const Geometry*>(sidewalk_g));
-                        if (intersection->getGeometryType() == "MultiPoint") {
-                            MultiPoint* multipoint = dynamic_cast<MultiPoint*>(
-                                    intersection);
-                            split_and_create(pedestrian, sidewalk, multipoint,
-                                    count_intersects);
-                        } else {
-                            Point* intersection_point = dynamic_cast<Point*>(intersection);
-                            split_and_create(pedestrian, sidewalk,
-                                    intersection_point, count_intersects);
-                        }
-                    }
+                for (size_t i = sidewalk_begin; i < sidewalk_end; ++i) {
+                    Sidewalk* sidewalk = sidewalks[sidewalk_pairs[i].second];
+                    add_splits(worker, pedestrian, sidewalk, nullptr,
+                            dynamic_cast<LineString*>(sidewalk->geometry),
+                            count_intersects);
                 }
             }
-            vector<void *> results_crossing;
-            ds.crossing_tree.query(pedestrian_g->getEnvelopeInternal(), results_crossing);
-            if (results_crossing.size() > 1) {
+            if (has_crossings) {
                 int count_intersects = 0;
-                Crossing* crossing = nullptr;
-                for (auto result : results_crossing) {
-                    crossing = static_cast<Crossing*>(result);
-                    Geometry* crossing_g = crossing->geometry;
-                    if (pedestrian_g->intersects(const_cast<const Geometry*>(crossing_g))) {
-                        count_intersects++;
-                        Geometry* intersection = pedestrian_g->intersection(
-                                const_cast<const Geometry*>(crossing_g));
-                        if (intersection->getGeometryType() == "MultiPoint") {
-                            MultiPoint* multipoint = dynamic_cast<MultiPoint*>(
-                                    intersection);
-                            split_and_create(pedestrian, crossing, multipoint,
-                                    count_intersects);
-                        } else {
-                            Point* intersection_point = dynamic_cast<Point*>(intersection);
-                            split_and_create(pedestrian, crossing,
-                                    intersection_point, count_intersects);
-                        }
-                    }
+                for (size_t i = crossing_begin; i < crossing_end; ++i) {
+                    Crossing* crossing = crossings[crossing_pairs[i].second];
+                    add_splits(worker, pedestrian, nullptr, crossing,
+                            dynamic_cast<LineString*>(crossing->geometry),
+                            count_intersects);
                 }
             }
-        }
+        });
+        merge_changes(workers);
         insert_changes();
     }
 };
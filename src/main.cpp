@@ -16,10 +16,13 @@
 
 #include <iostream>
 #include <getopt.h>
+#include <cerrno>
+#include <cstdint>
 #include <iterator>
 #include <vector>
 
 #include <osmium/index/map/sparse_mem_array.hpp>
+#include <osmium/index/map/sparse_file_array.hpp>
 #include <osmium/handler/node_locations_for_ways.hpp>
 #include <osmium/visitor.hpp>
 #include <osmium/geom/factory.hpp>
@@ -35,6 +38,7 @@
 #include <osmium/geom/geos.hpp>
 //#include <osmium/geom/wkt.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <geos/algorithm/CGAlgorithmsDD.h>
 #include <geos/geom/Coordinate.h>
 #include <geos/geom/CoordinateFilter.h>
 #include <geos/geom/CoordinateArraySequence.h>
@@ -42,36 +46,52 @@
 #include <geos/geom/GeometryCollection.h>
 #include <geos/geom/GeometryFactory.h>
 #include <geos/geom/LineSegment.h>
-#include <geos/index/strtree/STRtree.h>
+#include <geos/geom/prep/PreparedGeometry.h>
+#include <geos/geom/prep/PreparedGeometryFactory.h>
 #include <geos/io/WKBWriter.h>
 #include <geos/io/WKBReader.h>
-#include <geos/io/WKTReader.h>
 #include <google/sparse_hash_set>
 #include <google/sparse_hash_map>
 
 using namespace std;
 using namespace osmium;
 using namespace geos::geom;
-using namespace geos::index::strtree;
 
 typedef index::map::Dummy<unsigned_object_id_type,
         Location> index_neg_type;
-typedef index::map::SparseMemArray<unsigned_object_id_type,
+typedef index::map::Map<unsigned_object_id_type,
         Location> index_pos_type;
+typedef index::map::SparseMemArray<unsigned_object_id_type,
+        Location> index_mem_type;
+typedef index::map::SparseFileArray<unsigned_object_id_type,
+        Location> index_file_type;
 typedef handler::NodeLocationsForWays<index_pos_type, index_neg_type>
         location_handler_type;
 
+#include "timer.h"
+#include "simd_double.hpp"
 #include "geom_operate.hpp"
+#include "parameters.hpp"
+#include "profile.hpp"
+#include "run_file.hpp"
 #include "tag_check.hpp"
 #include "road.hpp"
 #include "pedro_point.hpp"
+#include "packed_rtree.hpp"
 #include "data_storage.hpp"
+#include "parallel.hpp"
+#include "spatial_join.hpp"
 #include "contrast.hpp"
+#include "analytic_contrast.hpp"
 #include "prepare_handler.hpp"
 #include "way_handler.hpp"
 #include "sidewalk_factory.hpp"
 #include "crossing_factory.hpp"
 #include "geometry_constructor.hpp"
+#include "snap_grid.hpp"
+#include "network_noder.hpp"
+#include "checkpoint.hpp"
+#include "stage_scheduler.hpp"
 
 
 void print_help() {
@@ -81,21 +101,285 @@ void print_help() {
          << "  -p            OUTFILE is name of postgis database\n"
          << "                - not default for performance reasons\n"
          << "                - it is recomanded to use shp2pgsql instead\n"
+         << "  -m, --node-file MB   store the node locations in a file\n"
+         << "                       and sort the node/way pairs of the\n"
+         << "                       first pass in run files of MB, this\n"
+         << "                       does not bound the memory of a run:\n"
+         << "                       the node maps, the roads and the\n"
+         << "                       sidewalks stay in memory\n"
+         << "  -l, --local-plane    calculate distances and offsets in\n"
+         << "                       local metric planes of latitude bands\n"
+         << "  -c, --checkpoint DIR write a checkpoint after each stage\n"
+         << "  -r, --resume-from STAGE\n"
+         << "                       load the checkpoint of STAGE from the\n"
+         << "                       checkpoint directory and run the later\n"
+         << "                       stages only, STAGE is one of\n"
+         << "                       ingestion, sidewalks, contrast,\n"
+         << "                       crossings, connection\n"
+         << "  -n, --noding         connect sidewalks, crossings and footways\n"
+         << "                       by noding all of them in one pass\n"
+         << "  -a, --analytic-contrast\n"
+         << "                       compare sidewalks and footways by their\n"
+         << "                       segments instead of orthogonal lines\n"
+         << "  -k, --chain-sidewalks\n"
+         << "                       create one sidewalk per side for the\n"
+         << "                       road between two junctions\n"
+         << "  -f, --lazy-crossings do not create the frequent crossings,\n"
+         << "                       store their ends (way id and fraction)\n"
+         << "                       in the layer crossing_pairs\n"
+         << "  -j, --threads N      number of worker threads, default is the\n"
+         << "                       number of cores\n"
+         << "  -C, --config FILE    read the parameters of the sidewalks,\n"
+         << "                       contrast and crossings from FILE\n"
+         << "  -s, --sweep FILE     ingest once and run the later stages for\n"
+         << "                       each parameter set [NAME] of FILE, the\n"
+         << "                       output of a set is OUTFILE_NAME, the\n"
+         << "                       ingestion is kept in the checkpoint\n"
+         << "                       directory\n"
+         << "  -P, --profiles FILE  ingest once and write the output of each\n"
+         << "                       profile [NAME] of FILE to OUTFILE_NAME\n"
          << "  -h, --help           This help message\n"
          //<< "  -d, --debug          Enable debug output !NOT IN USE\n"
          << endl;
 }
 
+/***
+ * Options of the stages after the reading of the OSM file.
+ */
+struct StageOptions {
+    bool spatial_order;
+    bool chains;
+    bool lazy_crossings;
+    bool analytic_contrast;
+    bool noding;
+    unsigned int num_threads;
+    int last_checkpoint;    // index of the last stage with a checkpoint
+    const Profile* profile; // applied to the ingestion, or nullptr
+    bool debug;
+};
+
+/***
+ * Run the stages beginning with the given stage and write the result. Stage
+ * 0 is the end of the ingestion, the ordering of the vehicle_node_map. A
+ * profile is applied after the checkpoint of the ingestion. The
+ * stages are tasks of a StageScheduler, so independent ones overlap: e.g.
+ * the orthogonals are created while the sidewalks are generated. The
+ * stages with worker threads get the threads that are free when they
+ * start, so all stages together use num_threads. The parts of the
+ * DataStorage are:
+ *   vehicle_map, pedestrians, sidewalks, crossings, crossing_pairs, orthos,
+ *   intersects (the sidewalks detected by the contrast)
+ *   output (the layers of the data source, they share one connection,
+ *           and the vertices of the topology of the ways layer)
+ * The DataStorage is cleaned up afterwards. The factories are created here,
+ * so they read the current Parameters.
+ */
+void run_stages(DataStorage& ds, location_handler_type& location_handler,
+        Checkpoint& checkpoint, int stage, string checkpoint_dir,
+        const StageOptions& options) {
+
+    const vector<string>& stages = Checkpoint::stages();
+    bool debug = options.debug;
+    GeometryConstructor geometry_constructor(ds, location_handler);
+    CrossingFactory crossing_factory(ds, location_handler);
+    StageScheduler scheduler(options.num_threads);
+    const vector<string> checkpoint_parts = {"vehicle_map", "pedestrians",
+            "sidewalks", "crossings", "crossing_pairs", "intersects",
+            "orthos"};
+    auto add_checkpoint = [&](int index) {
+        if (checkpoint_dir.empty() || (index > options.last_checkpoint)) {
+            return;
+        }
+        string stage_name = stages[index];
+        scheduler.add("checkpoint " + stage_name, checkpoint_parts,
+                {"checkpoint"}, [&checkpoint, checkpoint_dir, stage_name] {
+            checkpoint.save(checkpoint_dir, stage_name);
+        });
+    };
+
+    if (stage == 0) {
+        scheduler.add("order vehicle nodes", {}, {"vehicle_map"}, [&] {
+            ds.order_vehicle_node_map();
+        });
+        add_checkpoint(0);
+    }
+
+    if (options.profile && (stage <= 1)) {
+        scheduler.add("profile " + options.profile->name, {},
+                {"vehicle_map", "pedestrians"}, [&] {
+            ds.apply_profile(*options.profile);
+        });
+    }
+
+    /* the checkpoint of the sidewalks may hold the orthogonals and their
+     * index already */
+    if ((stage <= 2) && !options.analytic_contrast && ds.orthos.empty()) {
+        scheduler.add("orthogonals", {"pedestrians"}, {"orthos"}, [&] {
+            if (debug) cerr << "create orthogonals ..." << endl;
+            Contrast contrast(ds);
+            for (PedestrianRoad* road : ds.pedestrian_road_set) {
+                contrast.create_orthogonals(road->geometry);
+            }
+            contrast.build_ortho_index();
+        });
+    }
+
+    if (stage <= 1) {
+        scheduler.add_parallel("sidewalks", {"vehicle_map"},
+                {"sidewalks", "crossings"}, [&](unsigned int num_threads) {
+            if (debug) cerr << "generate sidewalks and osm crossings ..."
+                << endl;
+            geometry_constructor.generate_sidewalks(options.spatial_order,
+                    num_threads, options.chains);
+            if (debug) cerr << "sidewalks: " << ds.sidewalk_map.size()
+                << endl;
+        });
+        add_checkpoint(1);
+    }
+
+    if (stage <= 2) {
+        if (options.analytic_contrast) {
+            scheduler.add("contrast", {"pedestrians"},
+                    {"sidewalks", "intersects"}, [&] {
+                if (debug) cerr << "calculate analytic contrast ..." << endl;
+                AnalyticContrast contrast(ds);
+                contrast.check_sidewalks();
+            });
+        } else {
+            scheduler.add_parallel("contrast", {"pedestrians"},
+                    {"sidewalks", "intersects", "orthos"},
+                    [&](unsigned int num_threads) {
+                if (debug) cerr << "calculate contrast ..." << endl;
+                Contrast contrast(ds, num_threads);
+                contrast.check_sidewalks();
+                ds.clear_orthos();
+            });
+        }
+        add_checkpoint(2);
+    }
+
+    if (stage <= 3) {
+        scheduler.add("crossings", {"vehicle_map"},
+                {"sidewalks", "crossings", "crossing_pairs"}, [&] {
+            if (debug) cerr << "generate frequent crossing ..." << endl;
+            if (options.lazy_crossings) {
+                crossing_factory.store_frequent_crossings();
+            } else {
+                crossing_factory.generate_frequent_crossings();
+            }
+        });
+        add_checkpoint(3);
+    }
+
+    if (stage <= 4) {
+        scheduler.add_parallel("connection", {"vehicle_map"},
+                {"pedestrians", "sidewalks", "crossings"},
+                [&](unsigned int num_threads) {
+            if (debug) cerr << "snap footway ends ..." << endl;
+            SnapGrid snap_grid(ds);
+            int count_snapped = snap_grid.snap_pedestrians();
+            if (debug) cerr << "snapped footways: " << count_snapped << endl;
+
+            if (options.noding) {
+                if (debug) cerr << "node sidewalks, crossings and pedestrian"
+                    << " ..." << endl;
+                NetworkNoder network_noder(ds);
+                int count_split = network_noder.node_network();
+                if (debug) cerr << "split lines: " << count_split << endl;
+            } else {
+                if (debug) cerr << "connect sidewalks and pedestrian ..."
+                    << endl;
+                geometry_constructor.connect_sidewalks_and_pedesrians(
+                        num_threads);
+            }
+        });
+        add_checkpoint(4);
+    }
+
+    scheduler.add("insert ways", {"pedestrians", "vehicle_map"}, {"output"},
+            [&] {
+        if (debug) cerr << "vehicle_vehicle_node_map size: " << ds.vehicle_node_map.size() << endl;
+        if (debug) cerr << "croosing_node_map size: " << ds.crossing_node_map.size() << endl;
+        if (debug) cerr << "crossing_set size: " << ds.crossing_set.size() << endl;
+
+        if (debug) cerr << "insert ways ..." << endl;
+        ds.insert_ways();
+        //ds.insert_vehicle();
+    });
+    scheduler.add("insert sidewalks", {"sidewalks"}, {"output"}, [&] {
+        ds.insert_sidewalks();
+    });
+    scheduler.add("insert crossings", {"crossings"}, {"output"}, [&] {
+        ds.insert_crossings();
+    });
+    /* after the connection stage, it may split the sidewalks */
+    scheduler.add("insert crossing pairs", {"sidewalks", "crossing_pairs"},
+            {"output"}, [&] {
+        ds.insert_crossing_pairs();
+    });
+    scheduler.add("insert intersects", {"intersects"}, {"output"}, [&] {
+        ds.insert_intersects();
+    });
+    scheduler.add("insert vertices", {}, {"output"}, [&] {
+        ds.insert_vertices();
+    });
+    scheduler.run();
+    if (debug) {
+        cerr << "stage timing:" << endl;
+        scheduler.print_timing(cerr);
+    }
+
+    if (debug) cerr << "clean up ..." << endl;
+    ds.clean_up();
+}
+
+/***
+ * Parse a positive integer option, invalid values stop the program.
+ */
+long parse_positive(const char* text, string name) {
+    char* end = nullptr;
+    errno = 0;
+    long value = strtol(text, &end, 10);
+    if ((errno != 0) || (end == text) || (*end != '\0') || (value <= 0)) {
+        cerr << "invalid " << name << ": " << text << endl;
+        exit(1);
+    }
+    return value;
+}
+
 int main(int argc, char* argv[]) {
     static struct option long_options[] = { { "help", no_argument, 0, 'h' }, {
             "psql", no_argument, 0, 'p' }, {"debug", no_argument, 0, 'd' }, {
+            "node-file", required_argument, 0, 'm' }, {
+            "local-plane", no_argument, 0, 'l' }, {
+            "checkpoint", required_argument, 0, 'c' }, {
+            "resume-from", required_argument, 0, 'r' }, {
+            "noding", no_argument, 0, 'n' }, {
+            "analytic-contrast", no_argument, 0, 'a' }, {
+            "chain-sidewalks", no_argument, 0, 'k' }, {
+            "lazy-crossings", no_argument, 0, 'f' }, {
+            "threads", required_argument, 0, 'j' }, {
+            "config", required_argument, 0, 'C' }, {
+            "sweep", required_argument, 0, 's' }, {
+            "profiles", required_argument, 0, 'P' }, {
             0, 0, 0, 0 } };
 
     bool debug = false;
     bool psql = false;
+    size_t sort_buffer = 0;
+    string checkpoint_dir = "";
+    int resume_stage = -1;
+    bool noding = false;
+    bool analytic_contrast = false;
+    bool chains = false;
+    bool lazy_crossings = false;
+    unsigned int num_threads = max(thread::hardware_concurrency(), 1u);
+    vector<ParameterSet> sweep_sets;
+    vector<Profile> profiles;
 
     while (true) {
-        int c = getopt_long(argc, argv, "dhp:", long_options, 0);
+        int c = getopt_long(argc, argv, "dhp:m:lc:r:nakfj:C:s:P:", long_options,
+                0);
         if (c == -1) {
             break;
         }
@@ -109,6 +393,51 @@ int main(int argc, char* argv[]) {
         case 'd':
             debug = true;
             break;
+        case 'm':
+            sort_buffer = parse_positive(optarg, "sort buffer");
+            if (sort_buffer > SIZE_MAX / (1024 * 1024)) {
+                cerr << "invalid sort buffer: " << optarg << endl;
+                exit(1);
+            }
+            sort_buffer *= 1024 * 1024;
+            break;
+        case 'l':
+            LocalPlane::get().enabled = true;
+            break;
+        case 'c':
+            checkpoint_dir = optarg;
+            break;
+        case 'r':
+            resume_stage = Checkpoint::stage_index(optarg);
+            if (resume_stage < 0) {
+                cerr << "unknown stage: " << optarg << endl;
+                exit(1);
+            }
+            break;
+        case 'n':
+            noding = true;
+            break;
+        case 'a':
+            analytic_contrast = true;
+            break;
+        case 'k':
+            chains = true;
+            break;
+        case 'f':
+            lazy_crossings = true;
+            break;
+        case 'j':
+            num_threads = parse_positive(optarg, "number of threads");
+            break;
+        case 'C':
+            Parameters::get().read_file(optarg);
+            break;
+        case 's':
+            sweep_sets = Parameters::read_sweep(optarg);
+            break;
+        case 'P':
+            profiles = Profile::read_profiles(optarg);
+            break;
         default:
             exit(1);
         }
@@ -130,61 +459,107 @@ int main(int argc, char* argv[]) {
         exit(1);
     }
 
-    index_pos_type index_pos;
+    /* the profiles run like a sweep over their parameters */
+    if (!profiles.empty()) {
+        if (!sweep_sets.empty()) {
+            cerr << "a sweep can not be combined with profiles" << endl;
+            exit(1);
+        }
+        for (const Profile& profile : profiles) {
+            sweep_sets.push_back(profile.parameters);
+        }
+        Profile::get() = Profile::combine(profiles);
+    }
+
+    /* with a node file (-m) the node locations are stored in a file */
+    index_pos_type* index_pos = nullptr;
+    if (sort_buffer > 0) {
+        index_pos = new index_file_type();
+    } else {
+        index_pos = new index_mem_type();
+    }
     index_neg_type index_neg;
-    location_handler_type location_handler(index_pos, index_neg);
+    location_handler_type location_handler(*index_pos, index_neg);
     location_handler.ignore_errors();
-    DataStorage ds(output_filename, location_handler, psql);
-    GeomOperate go;
-    GeometryConstructor geometry_constructor(ds, location_handler);
-    CrossingFactory crossing_factory(ds, location_handler);
-    
-    if (debug) cerr << "start reading osm once ..." << endl;
-    io::Reader reader1(input_filename);
-    PrepareHandler prepare_handler(ds, location_handler);
-    apply(reader1, location_handler, prepare_handler);
-
-    if (debug) cerr << "insert osm footways ..." << endl;
-    prepare_handler.create_pedestrian_node_map();
-    reader1.close();
-
-    if (debug) cerr << "start reading osm twice ..." << endl;
-    io::Reader reader2(input_filename);
-    WayHandler way_handler(ds, location_handler);
-    apply(reader2, location_handler, way_handler);
-    reader2.close();
-
-    if (debug) cerr << "generate sidewalks and osm crossings ..."
-        << endl;
-    geometry_constructor.generate_sidewalks();
-
-    if (debug) cerr << "calculate contrast ..." << endl;
-    Contrast contrast = Contrast(ds);
-    contrast.check_sidewalks();
-
-    if (debug) cerr << "generate frequent crossing ..." << endl;
-    crossing_factory.generate_frequent_crossings();
-    
-    if (debug) cerr << "fill in sidewalk and crossing tree ..." << endl;
-    ds.fill_sidewalk_tree();
-    ds.fill_crossing_tree();
+    /* in a sweep each parameter set has its own output OUTFILE_NAME, the
+     * DataStorage opens the one of the first set */
+    auto set_output_filename = [&](size_t i) {
+        return output_filename + "_" + sweep_sets[i].name;
+    };
+    DataStorage ds(sweep_sets.empty() ? output_filename :
+            set_output_filename(0), location_handler, psql);
     
-    if (debug) cerr << "connect sidewalks and pedestrian ..." << endl;
-    geometry_constructor.connect_sidewalks_and_pedesrians();
+    Checkpoint checkpoint(ds, *index_pos, location_handler);
+    const vector<string>& stages = Checkpoint::stages();
+    int stage = 0;
+    if (!sweep_sets.empty() && (resume_stage > 0)) {
+        cerr << "a sweep can only resume from " << stages[0] << endl;
+        exit(1);
+    }
+    if (checkpoint_dir.empty() && ((resume_stage >= 0) ||
+            !sweep_sets.empty())) {
+        checkpoint_dir = ".";
+    }
+    if (resume_stage >= 0) {
+        if (debug) cerr << "resume from " << stages[resume_stage] << " ..."
+            << endl;
+        checkpoint.load(checkpoint_dir, stages[resume_stage]);
+        stage = resume_stage + 1;
+    }
 
-    if (debug) cerr << "vehicle_vehicle_node_map size: " << ds.vehicle_node_map.size() << endl;
-    if (debug) cerr << "croosing_node_map size: " << ds.crossing_node_map.size() << endl;
-    if (debug) cerr << "crossing_set size: " << ds.crossing_set.size() << endl;
+    if (stage == 0) {
+        if (debug) cerr << "start reading osm once ..." << endl;
+        io::Reader reader1(input_filename);
+        /* the buffer bounds the run files of the node/way pairs */
+        PrepareHandler prepare_handler(ds, location_handler,
+                sort_buffer);
+        apply(reader1, location_handler, prepare_handler);
 
-    if (debug) cerr << "insert ways ..." << endl;
-    ds.insert_ways();
-    //ds.insert_vehicle();
-    ds.insert_sidewalks();
-    ds.insert_crossings();
+        if (debug) cerr << "insert osm footways ..." << endl;
+        prepare_handler.create_pedestrian_node_map();
+        reader1.close();
 
-    if (debug) cerr << "clean up ..." << endl;
-    ds.clean_up();
+        if (debug) cerr << "start reading osm twice ..." << endl;
+        io::Reader reader2(input_filename);
+        WayHandler way_handler(ds, location_handler);
+        apply(reader2, location_handler, way_handler);
+        reader2.close();
+    }
+
+    /* a sweep keeps only the checkpoint of the ingestion */
+    int last_checkpoint = sweep_sets.empty() ? stages.size() - 1 : 0;
+    StageOptions options = {sort_buffer > 0, chains, lazy_crossings,
+            analytic_contrast, noding, num_threads, last_checkpoint, nullptr,
+            debug};
+    if (sweep_sets.empty()) {
+        run_stages(ds, location_handler, checkpoint, stage, checkpoint_dir,
+                options);
+    } else {
+        /* every set starts from the ingestion and the base parameters */
+        Parameters base_parameters = Parameters::get();
+        for (size_t i = 0; i < sweep_sets.size(); ++i) {
+            Parameters::get() = base_parameters;
+            Parameters::get().set(sweep_sets[i]);
+            if (!profiles.empty()) {
+                Profile::get() = profiles[i];
+                options.profile = &profiles[i];
+            }
+            if (i > 0) {
+                ds.reopen_db(set_output_filename(i));
+                checkpoint.load(checkpoint_dir, stages[0], false);
+                stage = 1;
+            }
+            if (debug) cerr << "output: " << set_output_filename(i) << endl;
+            if (debug) {
+                cerr << "parameter set " << sweep_sets[i].name << ":" << endl;
+                Parameters::get().print(cerr);
+            }
+            run_stages(ds, location_handler, checkpoint, stage,
+                    checkpoint_dir, options);
+        }
+    }
 
+    delete index_pos;
     cerr << "ready!" << endl;
 
     /*** TEST GEOM OPERATOR ***
@@ -0,0 +1,233 @@
+/***
+ * network_noder.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nathanael
+ *
+ *  Alternative to GeometryConstructor::connect_sidewalks_and_pedesrians
+ *  (-n). All sidewalks, crossings and OSM pedestrian ways are noded together
+ *  in one pass of the monotone chain noder of GEOS. Every line is split at
+ *  all its nodes, so the result is a fully noded network. Intersections of
+ *  two OSM pedestrian ways are not noded, they are bridges or tunnels if OSM
+ *  has no common node.
+ *
+ */
+
+#ifndef NETWORK_NODER_HPP_
+#define NETWORK_NODER_HPP_
+
+#include <geos/algorithm/LineIntersector.h>
+#include <geos/noding/IntersectionAdder.h>
+#include <geos/noding/MCIndexNoder.h>
+#include <geos/noding/NodedSegmentString.h>
+#include <geos/noding/SegmentIntersector.h>
+
+class NetworkNoder {
+
+    enum SourceType {
+        pedestrian_source,
+        sidewalk_source,
+        crossing_source
+    };
+
+    /***
+     * Origin of a segment string, the noded pieces are collected in order.
+     */
+    struct NodingSource {
+        SourceType type;
+        PedroRoad* road;
+        vector<Geometry*> pieces;
+
+        NodingSource(SourceType type, PedroRoad* road) :
+                type(type),
+                road(road) {
+        }
+    };
+
+    /***
+     * Adds the intersections like the IntersectionAdder, but skips pairs of
+     * OSM pedestrian ways.
+     */
+    class PedroIntersector : public geos::noding::SegmentIntersector {
+
+        geos::noding::IntersectionAdder& adder;
+
+    public:
+
+        explicit PedroIntersector(geos::noding::IntersectionAdder& adder) :
+                adder(adder) {
+        }
+
+        void processIntersections(geos::noding::SegmentString* e0,
+                int segIndex0, geos::noding::SegmentString* e1,
+                int segIndex1) {
+
+            const NodingSource* source0 =
+                    static_cast<const NodingSource*>(e0->getData());
+            const NodingSource* source1 =
+                    static_cast<const NodingSource*>(e1->getData());
+            if ((e0 != e1) && (source0->type == pedestrian_source) &&
+                    (source1->type == pedestrian_source)) {
+                return;
+            }
+            adder.processIntersections(e0, segIndex0, e1, segIndex1);
+        }
+    };
+
+    DataStorage& ds;
+    GeomOperate go;
+    GeometryFactory geos_factory;
+    vector<NodingSource> sources;
+    google::sparse_hash_set<string> used_ids;
+
+    void add_source(SourceType type, PedroRoad* road) {
+        if ((road->geometry->getNumPoints() < 2) || (road->length == 0)) {
+            return;
+        }
+        sources.push_back(NodingSource(type, road));
+    }
+
+    /***
+     * Next index after index, whose ID is not used yet by a pedestrian way,
+     * sidewalk or crossing.
+     */
+    int next_free_index(PedroRoad* road, int index) {
+        do {
+            index++;
+        } while (used_ids.find(road->with_index(index)) != used_ids.end());
+        return index;
+    }
+
+    /***
+     * The first piece keeps the ID, the others get the next free index.
+     * The replaced road and its geometry are destroyed.
+     */
+    void replace_pedestrian(NodingSource& source) {
+        PedestrianRoad* pedestrian = static_cast<PedestrianRoad*>(
+                source.road);
+        int index = pedestrian->get_index();
+        ds.pedestrian_road_set.erase(pedestrian);
+        ds.pedestrian_road_set.insert(new PedestrianRoad(index, pedestrian,
+                source.pieces[0]));
+        for (size_t i = 1; i < source.pieces.size(); ++i) {
+            index = next_free_index(pedestrian, index);
+            PedestrianRoad* piece = new PedestrianRoad(index, pedestrian,
+                    source.pieces[i]);
+            used_ids.insert(piece->id);
+            ds.pedestrian_road_set.insert(piece);
+        }
+        geos_factory.destroyGeometry(pedestrian->geometry);
+        delete pedestrian;
+    }
+
+    void replace_sidewalk(NodingSource& source) {
+        Sidewalk* sidewalk = static_cast<Sidewalk*>(source.road);
+        int index = sidewalk->get_index();
+        ds.sidewalk_map[sidewalk->id] = new Sidewalk(sidewalk,
+                source.pieces[0], index);
+        for (size_t i = 1; i < source.pieces.size(); ++i) {
+            index = next_free_index(sidewalk, index);
+            Sidewalk* piece = new Sidewalk(sidewalk, source.pieces[i], index);
+            used_ids.insert(piece->id);
+            ds.sidewalk_map[piece->id] = piece;
+        }
+        geos_factory.destroyGeometry(sidewalk->geometry);
+        delete sidewalk;
+    }
+
+    void replace_crossing(NodingSource& source) {
+        Crossing* crossing = static_cast<Crossing*>(source.road);
+        int index = crossing->get_index();
+        ds.crossing_set.erase(crossing);
+        ds.crossing_set.insert(new Crossing(crossing, source.pieces[0],
+                index));
+        for (size_t i = 1; i < source.pieces.size(); ++i) {
+            index = next_free_index(crossing, index);
+            Crossing* piece = new Crossing(crossing, source.pieces[i], index);
+            used_ids.insert(piece->id);
+            ds.crossing_set.insert(piece);
+        }
+        geos_factory.destroyGeometry(crossing->geometry);
+        delete crossing;
+    }
+
+public:
+
+    explicit NetworkNoder(DataStorage& data_storage) :
+            ds(data_storage) {
+        used_ids.set_deleted_key("");
+    }
+
+    /***
+     * Node all sidewalks, crossings and OSM pedestrian ways and replace the
+     * split ones by their pieces.
+     * Returns the number of split lines.
+     */
+    int node_network() {
+        sources.clear();
+        sources.reserve(ds.pedestrian_road_set.size() +
+                ds.sidewalk_map.size() + ds.crossing_set.size());
+        used_ids.clear();
+        for (PedestrianRoad* pedestrian : ds.pedestrian_road_set) {
+            add_source(pedestrian_source, pedestrian);
+            used_ids.insert(pedestrian->id);
+        }
+        for (auto map_entry : ds.sidewalk_map) {
+            add_source(sidewalk_source, map_entry.second);
+            used_ids.insert(map_entry.first);
+        }
+        for (Crossing* crossing : ds.crossing_set) {
+            add_source(crossing_source, crossing);
+            used_ids.insert(crossing->id);
+        }
+
+        /* the sources must not move while the noder holds the pointers */
+        geos::noding::SegmentString::NonConstVect segment_strings;
+        segment_strings.reserve(sources.size());
+        for (NodingSource& source : sources) {
+            segment_strings.push_back(new geos::noding::NodedSegmentString(
+                    source.road->geometry->getCoordinates(), &source));
+        }
+        geos::algorithm::LineIntersector line_intersector;
+        geos::noding::IntersectionAdder adder(line_intersector);
+        PedroIntersector intersector(adder);
+        geos::noding::MCIndexNoder noder(&intersector);
+        noder.computeNodes(&segment_strings);
+
+        geos::noding::SegmentString::NonConstVect* substrings =
+                noder.getNodedSubstrings();
+        for (geos::noding::SegmentString* substring : *substrings) {
+            NodingSource* source = static_cast<NodingSource*>(
+                    const_cast<void*>(substring->getData()));
+            source->pieces.push_back(geos_factory.createLineString(
+                    substring->getCoordinates()->clone()));
+            delete substring;
+        }
+        delete substrings;
+        for (geos::noding::SegmentString* segment_string : segment_strings) {
+            delete segment_string;
+        }
+
+        int count_split = 0;
+        for (NodingSource& source : sources) {
+            if (source.pieces.size() < 2) {
+                for (Geometry* piece : source.pieces) {
+                    geos_factory.destroyGeometry(piece);
+                }
+                continue;
+            }
+            count_split++;
+            if (source.type == pedestrian_source) {
+                replace_pedestrian(source);
+            } else if (source.type == sidewalk_source) {
+                replace_sidewalk(source);
+            } else {
+                replace_crossing(source);
+            }
+        }
+        sources.clear();
+        return count_split;
+    }
+};
+
+#endif /* NETWORK_NODER_HPP_ */
@@ -0,0 +1,486 @@
+/***
+ * packed_rtree.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nathanael
+ *
+ *  Static R-tree, bulk loaded and packed in Hilbert order of the box
+ *  centers. All nodes are stored in one contiguous array, leaves first and
+ *  the root last, so no node is allocated on its own. The children of a
+ *  node are found by its position, only the level bounds are stored.
+ *  The items are typed ids (e.g. positions in a vector) instead of void*.
+ *  Two trees can be joined by a synchronized traversal, see split_join.
+ *  A finished tree can be written to a file and mapped into memory again,
+ *  e.g. the tree of the orthogonals is kept with the checkpoint.
+ *
+ */
+
+#ifndef PACKED_RTREE_HPP_
+#define PACKED_RTREE_HPP_
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <geos/geom/Envelope.h>
+
+template <typename TId>
+class PackedRTree {
+
+    struct Box {
+        double min_x;
+        double min_y;
+        double max_x;
+        double max_y;
+
+        bool intersects(const Envelope& envelope) const {
+            return (min_x <= envelope.getMaxX()) &&
+                    (max_x >= envelope.getMinX()) &&
+                    (min_y <= envelope.getMaxY()) &&
+                    (max_y >= envelope.getMinY());
+        }
+
+        bool intersects(const Box& other) const {
+            return (min_x <= other.max_x) && (max_x >= other.min_x) &&
+                    (min_y <= other.max_y) && (max_y >= other.min_y);
+        }
+    };
+
+public:
+
+    /***
+     * Node of a finished tree: position in the node array and level, the
+     * leaves (items) have level 0.
+     */
+    struct Node {
+        size_t position;
+        size_t level;
+    };
+
+    typedef pair<Node, Node> node_pair_type;
+
+private:
+
+    const char* MAGIC = "PEDRORT1";
+
+    //PARAMETERS
+    const size_t node_size = 16;
+
+    // building, the vectors are empty if the tree is mapped
+    vector<Box> boxes;
+    vector<TId> ids;
+
+    // finished tree
+    const Box* box_data;
+    const TId* id_data;
+    vector<uint64_t> level_bounds;
+    size_t num_items;
+
+    // mapped file
+    void* map_data;
+    size_t map_size;
+
+    /***
+     * Position on the hilbert curve of a point in a 2^16 x 2^16 grid.
+     */
+    static uint32_t hilbert(uint32_t x, uint32_t y) {
+        const uint32_t n = 1 << 16;
+        uint32_t d = 0;
+        for (uint32_t s = n / 2; s > 0; s /= 2) {
+            uint32_t rx = (x & s) > 0;
+            uint32_t ry = (y & s) > 0;
+            d += s * s * ((3 * rx) ^ ry);
+            if (ry == 0) {
+                if (rx == 1) {
+                    x = n - 1 - x;
+                    y = n - 1 - y;
+                }
+                swap(x, y);
+            }
+        }
+        return d;
+    }
+
+    /***
+     * Sort the leaves by the hilbert value of their centers.
+     */
+    void sort_leaves() {
+        Box extent = boxes[0];
+        for (const Box& box : boxes) {
+            extent.min_x = min(extent.min_x, box.min_x);
+            extent.min_y = min(extent.min_y, box.min_y);
+            extent.max_x = max(extent.max_x, box.max_x);
+            extent.max_y = max(extent.max_y, box.max_y);
+        }
+        double width = extent.max_x - extent.min_x;
+        double height = extent.max_y - extent.min_y;
+        double scale_x = (width > 0) ? 65535 / width : 0;
+        double scale_y = (height > 0) ? 65535 / height : 0;
+        vector<pair<uint32_t, size_t>> order;
+        order.reserve(num_items);
+        for (size_t i = 0; i < num_items; ++i) {
+            const Box& box = boxes[i];
+            double center_x = (box.min_x + box.max_x) / 2;
+            double center_y = (box.min_y + box.max_y) / 2;
+            uint32_t x = (center_x - extent.min_x) * scale_x;
+            uint32_t y = (center_y - extent.min_y) * scale_y;
+            order.push_back(pair<uint32_t, size_t>(hilbert(x, y), i));
+        }
+        sort(order.begin(), order.end());
+        vector<Box> sorted_boxes;
+        vector<TId> sorted_ids;
+        sorted_boxes.reserve(boxes.capacity());
+        sorted_ids.reserve(num_items);
+        for (auto entry : order) {
+            sorted_boxes.push_back(boxes[entry.second]);
+            sorted_ids.push_back(ids[entry.second]);
+        }
+        boxes.swap(sorted_boxes);
+        ids.swap(sorted_ids);
+    }
+
+    Node get_root() const {
+        Node root = {level_bounds.back() - 1, level_bounds.size() - 1};
+        return root;
+    }
+
+    /***
+     * Range [begin, end) of the children of a node above the leaves.
+     */
+    void get_children(const Node& node, size_t& begin, size_t& end) const {
+        size_t level_begin = (node.level > 1) ?
+                level_bounds[node.level - 2] : 0;
+        size_t level_end = level_bounds[node.level - 1];
+        begin = level_begin + (node.position - level_bounds[node.level - 1])
+                * node_size;
+        end = min(begin + node_size, level_end);
+    }
+
+    /***
+     * Step of the synchronized traversal of join: the node of the higher
+     * level is replaced by its children, both on the same level. Appends
+     * the child pairs with intersecting boxes.
+     */
+    void expand(const PackedRTree& other, const node_pair_type& nodes,
+            vector<node_pair_type>& result) const {
+
+        Node node = nodes.first;
+        Node other_node = nodes.second;
+        size_t begin = node.position;
+        size_t end = begin + 1;
+        size_t other_begin = other_node.position;
+        size_t other_end = other_begin + 1;
+        if ((node.level > 0) && (node.level >= other_node.level)) {
+            get_children(node, begin, end);
+            node.level--;
+        }
+        if ((other_node.level > 0) && (other_node.level >= nodes.first.level)) {
+            other.get_children(other_node, other_begin, other_end);
+            other_node.level--;
+        }
+        for (size_t i = begin; i < end; ++i) {
+            for (size_t j = other_begin; j < other_end; ++j) {
+                if (box_data[i].intersects(other.box_data[j])) {
+                    Node child = {i, node.level};
+                    Node other_child = {j, other_node.level};
+                    result.push_back(node_pair_type(child, other_child));
+                }
+            }
+        }
+    }
+
+    void set_data() {
+        box_data = boxes.data();
+        id_data = ids.data();
+    }
+
+    void unmap() {
+        if (map_data) {
+            munmap(map_data, map_size);
+            map_data = nullptr;
+            map_size = 0;
+        }
+    }
+
+public:
+
+    PackedRTree() :
+            box_data(nullptr),
+            id_data(nullptr),
+            num_items(0),
+            map_data(nullptr),
+            map_size(0) {
+    }
+
+    PackedRTree(const PackedRTree&) = delete;
+    PackedRTree& operator=(const PackedRTree&) = delete;
+
+    ~PackedRTree() {
+        unmap();
+    }
+
+    /***
+     * Remove all items and the mapping, the tree can be filled again.
+     */
+    void clear() {
+        unmap();
+        boxes.clear();
+        ids.clear();
+        level_bounds.clear();
+        num_items = 0;
+        set_data();
+    }
+
+    /***
+     * Add an item before finish is called.
+     */
+    void add(TId id, const Envelope& envelope) {
+        Box box = {envelope.getMinX(), envelope.getMinY(),
+                envelope.getMaxX(), envelope.getMaxY()};
+        boxes.push_back(box);
+        ids.push_back(id);
+    }
+
+    /***
+     * Sort the items and build the upper levels. Each node covers node_size
+     * nodes of the level below.
+     */
+    void finish() {
+        unmap();
+        num_items = ids.size();
+        level_bounds.clear();
+        if (num_items == 0) {
+            set_data();
+            return;
+        }
+        sort_leaves();
+        size_t num_nodes = num_items;
+        size_t level_size = num_items;
+        do {
+            level_size = (level_size + node_size - 1) / node_size;
+            num_nodes += level_size;
+        } while (level_size > 1);
+        boxes.reserve(num_nodes);
+        size_t level_begin = 0;
+        size_t level_end = num_items;
+        level_bounds.push_back(level_end);
+        while (level_end - level_begin > 1) {
+            for (size_t i = level_begin; i < level_end; i += node_size) {
+                Box parent = boxes[i];
+                size_t end = min(i + node_size, level_end);
+                for (size_t j = i + 1; j < end; ++j) {
+                    parent.min_x = min(parent.min_x, boxes[j].min_x);
+                    parent.min_y = min(parent.min_y, boxes[j].min_y);
+                    parent.max_x = max(parent.max_x, boxes[j].max_x);
+                    parent.max_y = max(parent.max_y, boxes[j].max_y);
+                }
+                boxes.push_back(parent);
+            }
+            level_begin = level_end;
+            level_end = boxes.size();
+            level_bounds.push_back(level_end);
+        }
+        set_data();
+    }
+
+    size_t size() const {
+        return num_items;
+    }
+
+    /***
+     * Call the visitor with the id of every item intersecting the envelope.
+     */
+    template <typename TVisitor>
+    void query(const Envelope& envelope, TVisitor visitor) const {
+        if (num_items == 0) {
+            return;
+        }
+        // pairs of node position and level
+        vector<pair<size_t, size_t>> stack;
+        stack.push_back(pair<size_t, size_t>(level_bounds.back() - 1,
+                level_bounds.size() - 1));
+        while (!stack.empty()) {
+            size_t position = stack.back().first;
+            size_t level = stack.back().second;
+            stack.pop_back();
+            if (!box_data[position].intersects(envelope)) {
+                continue;
+            }
+            if (level == 0) {
+                visitor(id_data[position]);
+                continue;
+            }
+            size_t level_begin = (level > 1) ? level_bounds[level - 2] : 0;
+            size_t level_end = level_bounds[level - 1];
+            size_t child = level_begin + (position - level_bounds[level - 1])
+                    * node_size;
+            size_t child_end = min(child + node_size, level_end);
+            for (; child < child_end; ++child) {
+                stack.push_back(pair<size_t, size_t>(child, level - 1));
+            }
+        }
+    }
+
+    /***
+     * Start of a join of this tree with other: node pairs with intersecting
+     * boxes, expanded from the roots until there are at least min_pairs or
+     * only items are left. join_nodes of every pair gives the whole join
+     * once, so the pairs can be processed on different threads.
+     */
+    vector<node_pair_type> split_join(const PackedRTree& other,
+            size_t min_pairs) const {
+
+        vector<node_pair_type> nodes;
+        if ((num_items == 0) || (other.num_items == 0)) {
+            return nodes;
+        }
+        Node root = get_root();
+        Node other_root = other.get_root();
+        if (!box_data[root.position].intersects(
+                other.box_data[other_root.position])) {
+            return nodes;
+        }
+        nodes.push_back(node_pair_type(root, other_root));
+        vector<node_pair_type> next_nodes;
+        bool expanded = true;
+        while (expanded && (nodes.size() < min_pairs)) {
+            expanded = false;
+            next_nodes.clear();
+            for (const node_pair_type& candidate : nodes) {
+                if ((candidate.first.level == 0) &&
+                        (candidate.second.level == 0)) {
+                    next_nodes.push_back(candidate);
+                } else {
+                    expand(other, candidate, next_nodes);
+                    expanded = true;
+                }
+            }
+            nodes.swap(next_nodes);
+        }
+        return nodes;
+    }
+
+    /***
+     * Synchronized traversal below a pair of split_join. Calls the visitor
+     * with the ids of every pair of intersecting items.
+     */
+    template <typename TVisitor>
+    void join_nodes(const PackedRTree& other, const node_pair_type& start,
+            TVisitor visitor) const {
+
+        vector<node_pair_type> stack(1, start);
+        while (!stack.empty()) {
+            node_pair_type nodes = stack.back();
+            stack.pop_back();
+            if ((nodes.first.level == 0) && (nodes.second.level == 0)) {
+                visitor(id_data[nodes.first.position],
+                        other.id_data[nodes.second.position]);
+            } else {
+                expand(other, nodes, stack);
+            }
+        }
+    }
+
+    /***
+     * Call the visitor with the ids of every pair of intersecting items of
+     * this tree and other.
+     */
+    template <typename TVisitor>
+    void join(const PackedRTree& other, TVisitor visitor) const {
+        for (const node_pair_type& nodes : split_join(other, 1)) {
+            join_nodes(other, nodes, visitor);
+        }
+    }
+
+    /***
+     * Write the finished tree to a file.
+     * Layout: magic, number of items, number of levels, level bounds,
+     * boxes, ids.
+     */
+    void save(string path) const {
+        FILE* out = fopen(path.c_str(), "wb");
+        if (!out) {
+            cerr << "Failed to open index " << path << endl;
+            exit(1);
+        }
+        uint64_t header[2] = {num_items, level_bounds.size()};
+        size_t num_boxes = level_bounds.empty() ? 0 : level_bounds.back();
+        bool written = (fwrite(MAGIC, 1, strlen(MAGIC), out) ==
+                strlen(MAGIC)) &&
+                (fwrite(header, sizeof(uint64_t), 2, out) == 2) &&
+                (fwrite(level_bounds.data(), sizeof(uint64_t),
+                        level_bounds.size(), out) == level_bounds.size()) &&
+                (fwrite(box_data, sizeof(Box), num_boxes, out) ==
+                        num_boxes) &&
+                (fwrite(id_data, sizeof(TId), num_items, out) == num_items);
+        if ((fclose(out) != 0) || !written) {
+            cerr << "Failed to write index " << path << endl;
+            exit(1);
+        }
+    }
+
+    /***
+     * Map a tree written by save into memory, the boxes and ids are not
+     * copied.
+     */
+    void load(string path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            cerr << "Failed to open index " << path << endl;
+            exit(1);
+        }
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0) {
+            cerr << "Failed to read index " << path << endl;
+            exit(1);
+        }
+        clear();
+        size_t header_size = strlen(MAGIC) + 2 * sizeof(uint64_t);
+        if ((size_t) file_stat.st_size < header_size) {
+            cerr << path << " is no packed R-tree" << endl;
+            exit(1);
+        }
+        map_size = file_stat.st_size;
+        map_data = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map_data == MAP_FAILED) {
+            map_data = nullptr;
+            map_size = 0;
+            cerr << "Failed to map index " << path << endl;
+            exit(1);
+        }
+        const char* position = static_cast<const char*>(map_data);
+        const char* end = position + map_size;
+        if (memcmp(position, MAGIC, strlen(MAGIC)) != 0) {
+            cerr << path << " is no packed R-tree" << endl;
+            exit(1);
+        }
+        position += strlen(MAGIC);
+        uint64_t header[2];
+        memcpy(header, position, sizeof(header));
+        position += sizeof(header);
+        size_t bounds_size = header[1] * sizeof(uint64_t);
+        if (bounds_size > (size_t) (end - position)) {
+            cerr << "Index " << path << " is truncated." << endl;
+            exit(1);
+        }
+        level_bounds.resize(header[1]);
+        memcpy(level_bounds.data(), position, bounds_size);
+        position += bounds_size;
+        size_t num_boxes = level_bounds.empty() ? 0 : level_bounds.back();
+        if (num_boxes * sizeof(Box) + header[0] * sizeof(TId) >
+                (size_t) (end - position)) {
+            cerr << "Index " << path << " is truncated." << endl;
+            exit(1);
+        }
+        num_items = header[0];
+        box_data = reinterpret_cast<const Box*>(position);
+        id_data = reinterpret_cast<const TId*>(position +
+                num_boxes * sizeof(Box));
+    }
+};
+
+#endif /* PACKED_RTREE_HPP_ */
@@ -0,0 +1,56 @@
+/***
+ * parallel.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nathanael
+ *
+ *  Worker loop shared by the parallel stages. Each worker has its own
+ *  state (GeomOperate, factories, buffers) and runs on its own thread.
+ *  Items are handed out in blocks by an atomic counter, so the assignment
+ *  of items to workers changes from run to run. The callers merge the
+ *  results of the workers, so they do not depend on it.
+ *
+ */
+
+#ifndef PARALLEL_HPP_
+#define PARALLEL_HPP_
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
+/***
+ * Call task(worker, item) for the items [0, count) on one thread per
+ * worker. A single worker runs on the calling thread.
+ */
+template <typename TWorker>
+void run_parallel(vector<TWorker>& workers, size_t count,
+        function<void(TWorker&, size_t)> task, size_t block_size = 64) {
+
+    atomic<size_t> next_item(0);
+    auto work = [&](TWorker& worker) {
+        while (true) {
+            size_t begin = next_item.fetch_add(block_size);
+            if (begin >= count) {
+                break;
+            }
+            size_t end = min(begin + block_size, count);
+            for (size_t item = begin; item < end; ++item) {
+                task(worker, item);
+            }
+        }
+    };
+    if (workers.size() == 1) {
+        work(workers[0]);
+        return;
+    }
+    vector<thread> threads;
+    for (TWorker& worker : workers) {
+        threads.push_back(thread(work, ref(worker)));
+    }
+    for (thread& worker_thread : threads) {
+        worker_thread.join();
+    }
+}
+
+#endif /* PARALLEL_HPP_ */
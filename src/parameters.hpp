@@ -0,0 +1,271 @@
+/***
+ * parameters.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nathanael
+ *
+ *  Runtime parameters of the sidewalk generation, the contrast, the
+ *  crossing generation and the costs of the topology. The defaults are the
+ *  former constants, they can be changed by a config file (-C) of
+ *  "key = value" lines. A sweep file (-s) holds several named parameter
+ *  sets:
+ *
+ *      # comment
+ *      [narrow]
+ *      sidewalk_offset = 0.003
+ *      contrast_factor = 0.6
+ *
+ *  Each set starts from the parameters of the config file. The classes read
+ *  the parameters when they are constructed.
+ *
+ */
+
+#ifndef PARAMETERS_HPP_
+#define PARAMETERS_HPP_
+
+#include <fstream>
+#include <functional>
+
+/***
+ * Named parameter set of a sweep file.
+ */
+struct ParameterSet {
+    string name;
+    vector<pair<string, double>> values;
+};
+
+struct Parameters {
+    // contrast
+    double segment_size;          // distance between orthogonal lines
+    double ortho_length;          // length of the orthogonal line
+    double contrast_factor;       // share of a sidewalk hit by orthogonals
+    double orientation_tolerance; // tolerance in degrees, for the
+                                  // orientation of sidewalk and
+                                  // pedestrian road
+    double min_length;            // minimal length of used pedestrian
+                                  // road segments
+    // sidewalks
+    double sidewalk_offset;       // distance of the sidewalk to the road
+    // crossings
+    double crossing_segment_size; // distance between frequent crossings
+    // topology
+    double frequent_crossing_cost; // cost per km of frequent and risk
+    double risk_crossing_cost;     // crossings, compared to other ways
+
+    Parameters() :
+            segment_size(0.01),
+            ortho_length(0.015),
+            contrast_factor(0.7),
+            orientation_tolerance(15),
+            min_length(0.05),
+            sidewalk_offset(0.0045),
+            crossing_segment_size(0.050),
+            frequent_crossing_cost(1.0),
+            risk_crossing_cost(2.0) {
+    }
+
+    static Parameters& get() {
+        static Parameters parameters;
+        return parameters;
+    }
+
+    /***
+     * Names of the parameters in config and sweep files.
+     */
+    static const vector<pair<string, double Parameters::*>>& names() {
+        static const vector<pair<string, double Parameters::*>> entries = {
+            {"segment_size", &Parameters::segment_size},
+            {"ortho_length", &Parameters::ortho_length},
+            {"contrast_factor", &Parameters::contrast_factor},
+            {"orientation_tolerance", &Parameters::orientation_tolerance},
+            {"min_length", &Parameters::min_length},
+            {"sidewalk_offset", &Parameters::sidewalk_offset},
+            {"crossing_segment_size", &Parameters::crossing_segment_size},
+            {"frequent_crossing_cost", &Parameters::frequent_crossing_cost},
+            {"risk_crossing_cost", &Parameters::risk_crossing_cost}};
+        return entries;
+    }
+
+    /***
+     * Valid range of a parameter as text, empty if value is in the range.
+     * Distances and sizes have to be positive, otherwise e.g. segmentize
+     * would never finish.
+     */
+    static string check_range(string key, double value) {
+        if (!isfinite(value)) {
+            return "finite";
+        }
+        if ((key == "contrast_factor") &&
+                ((value <= 0) || (value > 1))) {
+            return "in (0, 1]";
+        }
+        if ((key == "orientation_tolerance") &&
+                ((value < 0) || (value > 90))) {
+            return "in [0, 90]";
+        }
+        if (((key == "min_length") || (key == "frequent_crossing_cost") ||
+                (key == "risk_crossing_cost")) && (value < 0)) {
+            return ">= 0";
+        }
+        if (((key == "segment_size") || (key == "ortho_length") ||
+                (key == "sidewalk_offset") ||
+                (key == "crossing_segment_size")) && (value <= 0)) {
+            return "> 0";
+        }
+        return "";
+    }
+
+    /***
+     * Set a parameter by its name. Returns false if the name is unknown.
+     */
+    bool set(string key, double value) {
+        for (auto entry : names()) {
+            if (entry.first == key) {
+                this->*entry.second = value;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void set(const ParameterSet& parameter_set) {
+        for (auto value : parameter_set.values) {
+            set(value.first, value.second);
+        }
+    }
+
+    void print(ostream& out) {
+        for (auto entry : names()) {
+            out << "  " << entry.first << " = " << this->*entry.second << endl;
+        }
+    }
+
+    /***
+     * Read a config file. Unknown keys and invalid values stop the program.
+     */
+    void read_file(string path) {
+        vector<ParameterSet> sets;
+        read_sets(path, false, sets);
+        set(sets[0]);
+    }
+
+    /***
+     * Read the parameter sets of a sweep file.
+     */
+    static vector<ParameterSet> read_sweep(string path) {
+        vector<ParameterSet> sets;
+        read_sets(path, true, sets);
+        if (sets.empty()) {
+            cerr << "No parameter set in " << path << endl;
+            exit(1);
+        }
+        return sets;
+    }
+
+    static string trim(string text) {
+        size_t begin = text.find_first_not_of(" \t\r");
+        if (begin == string::npos) {
+            return "";
+        }
+        size_t end = text.find_last_not_of(" \t\r");
+        return text.substr(begin, end - begin + 1);
+    }
+
+    static void parse_error(string path, int line_number, string message) {
+        cerr << path << ":" << line_number << ": " << message << endl;
+        exit(1);
+    }
+
+    /***
+     * Parse "key = value" lines, with sections each "[name]" starts a new
+     * section and section(name) is called. entry(key, value, line_number)
+     * is called for each line. Without sections all lines belong to one
+     * unnamed section.
+     */
+    static void read_entries(string path, bool with_sections,
+            function<void(string)> section,
+            function<void(string, string, int)> entry) {
+
+        ifstream in(path.c_str());
+        if (!in) {
+            cerr << "Failed to open parameter file " << path << endl;
+            exit(1);
+        }
+        vector<string> names;
+        string line;
+        int line_number = 0;
+        while (getline(in, line)) {
+            line_number++;
+            line = trim(line.substr(0, line.find('#')));
+            if (line.empty()) {
+                continue;
+            }
+            if (line[0] == '[') {
+                if (!with_sections || (line[line.size() - 1] != ']')) {
+                    parse_error(path, line_number, "invalid line: " + line);
+                }
+                string name = trim(line.substr(1, line.size() - 2));
+                if (name.empty()) {
+                    parse_error(path, line_number, "empty set name");
+                }
+                if (find(names.begin(), names.end(), name) != names.end()) {
+                    parse_error(path, line_number, "duplicate set " + name);
+                }
+                names.push_back(name);
+                section(name);
+                continue;
+            }
+            size_t equal = line.find('=');
+            if (equal == string::npos) {
+                parse_error(path, line_number, "invalid line: " + line);
+            }
+            if (with_sections && names.empty()) {
+                parse_error(path, line_number, "parameter outside of a set");
+            }
+            entry(trim(line.substr(0, equal)), trim(line.substr(equal + 1)),
+                    line_number);
+        }
+    }
+
+    /***
+     * Check a parameter of a file and add it to the set.
+     */
+    static void add_value(string path, int line_number, string key,
+            string value_text, ParameterSet& parameter_set) {
+
+        char* value_end = nullptr;
+        double value = strtod(value_text.c_str(), &value_end);
+        if (value_text.empty() || (*value_end != '\0')) {
+            parse_error(path, line_number, "invalid value: " + value_text);
+        }
+        Parameters check;
+        if (!check.set(key, value)) {
+            parse_error(path, line_number, "unknown parameter: " + key);
+        }
+        string range = check_range(key, value);
+        if (!range.empty()) {
+            parse_error(path, line_number, key + " has to be " + range +
+                    ": " + value_text);
+        }
+        parameter_set.values.push_back(pair<string, double>(key, value));
+    }
+
+private:
+
+    static void read_sets(string path, bool with_sections,
+            vector<ParameterSet>& sets) {
+
+        if (!with_sections) {
+            sets.push_back(ParameterSet());
+        }
+        read_entries(path, with_sections, [&](string name) {
+            ParameterSet parameter_set;
+            parameter_set.name = name;
+            sets.push_back(parameter_set);
+        }, [&](string key, string value, int line_number) {
+            add_value(path, line_number, key, value, sets.back());
+        });
+    }
+};
+
+#endif /* PARAMETERS_HPP_ */
@@ -9,18 +9,36 @@
  * pedestrian roads.
  * The crossing nodes are collected in the crossing_node_map to construct the
  * crossings later.
+ * With a node file (-m) the node/way pairs are spilled into sorted run
+ * files instead of the temp_node_map.
  *
  */
 
 #ifndef PREPARE_HANDLER_HPP_
 #define PREPARE_HANDLER_HPP_
 
+/***
+ * Record of the run files, sorted by node id.
+ */
+struct NodeWayPair {
+    object_id_type node_id;
+    object_id_type way_id;
+
+    bool operator<(const NodeWayPair& other) const {
+        if (node_id == other.node_id) {
+            return way_id < other.way_id;
+        }
+        return node_id < other.node_id;
+    }
+};
+
 class PrepareHandler : public handler::Handler {
 
     DataStorage& ds;
     location_handler_type& location_handler;
     google::sparse_hash_map<object_id_type,
             vector<object_id_type>> temp_node_map;
+    RunFile<NodeWayPair>* node_way_runs;
 
     /***
      * In the temp_node_map the way ids are collected for every node id.
@@ -28,17 +46,48 @@ class PrepareHandler : public handler::Handler {
     void prepare_pedestrian_road(Way& way) {
         object_id_type way_id = way.id();
         for (auto node : way.nodes()) {
-            temp_node_map[node.ref()].push_back(way_id);
+            if (node_way_runs) {
+                NodeWayPair pair = {node.ref(), way_id};
+                node_way_runs->add(pair);
+            } else {
+                temp_node_map[node.ref()].push_back(way_id);
+            }
+        }
+    }
+
+    /***
+     * Insert a node into the pedestrian_node_map for every way, if the node
+     * connects more than one pedestrian road.
+     */
+    void insert_pedestrian_node(object_id_type node_id,
+            vector<object_id_type>& way_ids) {
+
+        if (way_ids.size() > 1) {
+            for (object_id_type way_id : way_ids) {
+                ds.pedestrian_node_map[way_id].push_back(node_id);
+            }
         }
     }
 
 public:
 
+    /***
+     * sort_buffer in bytes, 0 keeps the temp_node_map in memory.
+     */
     explicit PrepareHandler(DataStorage& data_storage,
-            location_handler_type& location_handler) :
-            ds(data_storage), location_handler(location_handler) {
+            location_handler_type& location_handler,
+            size_t sort_buffer = 0) :
+            ds(data_storage), location_handler(location_handler),
+            node_way_runs(nullptr) {
 
 	temp_node_map.set_deleted_key(-1);
+        if (sort_buffer > 0) {
+            node_way_runs = new RunFile<NodeWayPair>(sort_buffer);
+        }
+    }
+
+    ~PrepareHandler() {
+        delete node_way_runs;
     }
 
     /***
@@ -69,13 +118,22 @@ public:
      * pedestrian road connects each other.
      */
     void create_pedestrian_node_map() {
-        for (auto entry : temp_node_map) {
-            if (entry.second.size() > 1) {
-                object_id_type node_id = entry.first;
-                for (object_id_type way_id : entry.second) {
-                    ds.pedestrian_node_map[way_id].push_back(node_id);
+        if (node_way_runs) {
+            object_id_type current_node = 0;
+            vector<object_id_type> way_ids;
+            node_way_runs->for_each_sorted([&](const NodeWayPair& pair) {
+                if (pair.node_id != current_node) {
+                    insert_pedestrian_node(current_node, way_ids);
+                    way_ids.clear();
+                    current_node = pair.node_id;
                 }
-            }
+                way_ids.push_back(pair.way_id);
+            });
+            insert_pedestrian_node(current_node, way_ids);
+            return;
+        }
+        for (auto entry : temp_node_map) {
+            insert_pedestrian_node(entry.first, entry.second);
         }
     }
 };
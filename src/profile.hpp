@@ -0,0 +1,203 @@
+/***
+ * profile.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nathanael
+ *
+ *  Routing profile, e.g. for wheelchair users. A profile decides which
+ *  highway types are vehicle roads and pedestrian ways, which sidewalks
+ *  untagged vehicle roads have and which frequent crossings are risk
+ *  crossings. The defaults are the former lists of TagCheck. A profile
+ *  file (-P) holds several named profiles:
+ *
+ *      [wheelchair]
+ *      pedestrian = pedestrian, footway, path, living_street
+ *      sidewalk = none            # both, left, right or none
+ *      risk_crossings = no        # no frequent crossings of risk roads
+ *      contrast_factor = 0.6      # any parameter of parameters.hpp
+ *
+ *  The other keys are vehicle and risk (highway types). The ingestion
+ *  reads the ways of all profiles once, see combine. Each profile is then
+ *  applied to the ingestion by DataStorage::apply_profile.
+ *
+ */
+
+#ifndef PROFILE_HPP_
+#define PROFILE_HPP_
+
+struct Profile {
+    string name;
+    vector<string> vehicle_types;     // highway types of vehicle roads
+    vector<string> pedestrian_types;  // highway types of pedestrian ways,
+                                      // cycleway only with foot=yes
+    char default_sidewalk;            // sidewalk of untagged vehicle roads
+    vector<string> risk_types;        // vehicle roads of risk crossings
+    bool risk_crossings;              // create frequent risk crossings
+    ParameterSet parameters;          // parameters of this profile
+
+    /* default_sidewalk of the ingestion, it is set by the profile */
+    static const char untagged_sidewalk = 'u';
+
+    Profile() :
+            vehicle_types({
+                /* ALL
+                "motorway", "trunk", "primary", "secondary", "tertiary",
+                "unclassified", "road", "residential", "service",
+                "motorway_link", "trunk_link", "primary_link",
+                "secondary_link", "tertiary_link", "bus_guideway"
+                */
+                // "motorway",
+                // "trunk",
+                "primary",
+                "secondary",
+                "tertiary",
+                "unclassified",
+                // "road",
+                "residential",
+                "service",
+                // "motorway_link",
+                // "trunk_link",
+                "primary_link",
+                "secondary_link",
+                "tertiary_link",
+                "bus_guideway"}),
+            pedestrian_types({
+                "pedestrian",
+                "footway",
+                "steps",
+                "path",
+                "track",
+                "living_street",
+                "cycleway"}),
+            default_sidewalk('b'),
+            risk_types({
+                "primary",
+                "primary_link"}),
+            risk_crossings(true) {
+    }
+
+    /***
+     * Profile of the current run.
+     */
+    static Profile& get() {
+        static Profile profile;
+        return profile;
+    }
+
+    static bool in_list(string type, const vector<string>& types) {
+        return find(types.begin(), types.end(), type) != types.end();
+    }
+
+    bool is_vehicle_type(string type) const {
+        return in_list(type, vehicle_types);
+    }
+
+    bool is_pedestrian_type(string type) const {
+        return in_list(type, pedestrian_types);
+    }
+
+    bool is_risk_type(string type) const {
+        return in_list(type, risk_types);
+    }
+
+    /***
+     * Profile of the ingestion for several profiles: the ways of all
+     * profiles are read and the sidewalks of untagged roads are left open.
+     */
+    static Profile combine(const vector<Profile>& profiles) {
+        Profile combined;
+        combined.name = "combined";
+        combined.vehicle_types.clear();
+        combined.pedestrian_types.clear();
+        combined.default_sidewalk = untagged_sidewalk;
+        for (const Profile& profile : profiles) {
+            for (string type : profile.vehicle_types) {
+                if (!combined.is_vehicle_type(type)) {
+                    combined.vehicle_types.push_back(type);
+                }
+            }
+            for (string type : profile.pedestrian_types) {
+                if (!combined.is_pedestrian_type(type)) {
+                    combined.pedestrian_types.push_back(type);
+                }
+            }
+        }
+        return combined;
+    }
+
+    /***
+     * Read the profiles of a profile file. Each profile starts from the
+     * defaults, unknown keys and invalid values stop the program.
+     */
+    static vector<Profile> read_profiles(string path) {
+        vector<Profile> profiles;
+        Parameters::read_entries(path, true, [&](string name) {
+            Profile profile;
+            profile.name = name;
+            profile.parameters.name = name;
+            profiles.push_back(profile);
+        }, [&](string key, string value, int line_number) {
+            profiles.back().set(path, line_number, key, value);
+        });
+        if (profiles.empty()) {
+            cerr << "No profile in " << path << endl;
+            exit(1);
+        }
+        return profiles;
+    }
+
+private:
+
+    /***
+     * Comma separated list of highway types.
+     */
+    static vector<string> split_list(string value) {
+        vector<string> items;
+        size_t begin = 0;
+        while (begin <= value.size()) {
+            size_t end = value.find(',', begin);
+            if (end == string::npos) {
+                end = value.size();
+            }
+            string item = Parameters::trim(value.substr(begin, end - begin));
+            if (!item.empty()) {
+                items.push_back(item);
+            }
+            begin = end + 1;
+        }
+        return items;
+    }
+
+    void set(string path, int line_number, string key, string value) {
+        if (key == "vehicle") {
+            vehicle_types = split_list(value);
+        } else if (key == "pedestrian") {
+            pedestrian_types = split_list(value);
+        } else if (key == "risk") {
+            risk_types = split_list(value);
+        } else if (key == "sidewalk") {
+            if (value == "both") {
+                default_sidewalk = 'b';
+            } else if (value == "left") {
+                default_sidewalk = 'l';
+            } else if (value == "right") {
+                default_sidewalk = 'r';
+            } else if (value == "none") {
+                default_sidewalk = 'n';
+            } else {
+                Parameters::parse_error(path, line_number,
+                        "invalid sidewalk: " + value);
+            }
+        } else if (key == "risk_crossings") {
+            if ((value != "yes") && (value != "no")) {
+                Parameters::parse_error(path, line_number,
+                        "invalid risk_crossings: " + value);
+            }
+            risk_crossings = (value == "yes");
+        } else {
+            Parameters::add_value(path, line_number, key, value, parameters);
+        }
+    }
+};
+
+#endif /* PROFILE_HPP_ */
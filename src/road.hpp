@@ -6,12 +6,14 @@
  *
  * 
  * Identifiers are:
- *  PedestrianRoad:     osm id|index[00..99]
+ *  PedestrianRoad:     osm id|index[0000..9999]
  *  VehicleRoad:        osm id|index[000..999]
- *  Sidewalk:           form|to|left/right[0..1]|index[00..99]
- *    index is 00 as long as LineString is not splitted
- *  Crossing:           form|to|left/right[0..1]|index[00..99]
- *    index is 00 as long as LineString is not splitted
+ *  Sidewalk:           form[6]|to[6]|left/right[0..1]|index[0000..9999]
+ *    index is 0001 as long as LineString is not splitted
+ *  Crossing:           form[6]|to[6]|left/right[0..1]|osm/frequent[2..3]|
+ *                      index[0000..9999]
+ *    index is 0001 as long as LineString is not splitted
+ *  The piece index always has INDEX_DIGITS digits at the end of the ID.
  *
  * Sidewalk Characters are:
  *  'l' = left
@@ -58,19 +60,34 @@ protected:
 
     GeomOperate go;
 
-    string pad_zeroes(int index, int num_char) {
-        string with_zeroes = "";
-        int factor = pow(10, (num_char - 1));
-        while ((factor > 0) && ((index / factor) == 0)) {
-            with_zeroes += "0";
-            factor *= 0.1;
+    /***
+     * The number with leading zeroes up to num_char digits.
+     */
+    static string pad_zeroes(int index, int num_char) {
+        string digits = to_string(index);
+        if (static_cast<int>(digits.size()) >= num_char) {
+            return digits;
         }
-        with_zeroes += to_string(index);
-        return with_zeroes;    
+        return string(num_char - digits.size(), '0') + digits;
+    }
+
+    /***
+     * Piece index of an ID, it stops the program if the index does not fit
+     * into INDEX_DIGITS.
+     */
+    static string format_index(int index) {
+        if ((index < 0) || (index > MAX_INDEX)) {
+            cerr << "piece index out of range: " << index << endl;
+            exit(1);
+        }
+        return pad_zeroes(index, INDEX_DIGITS);
     }
 
 public: 
 
+    static const int INDEX_DIGITS = 4;
+    static const int MAX_INDEX = 9999;
+
     string id;
     string name;
     string type;
@@ -112,6 +129,17 @@ public:
     OGRGeometry* get_ogr_geom() {
         return go.geos2ogr(geometry);
     }
+
+    int get_index() {
+        return stoi(id.substr(id.size() - INDEX_DIGITS));
+    }
+
+    /***
+     * The ID with another piece index.
+     */
+    string with_index(int index) {
+        return id.substr(0, id.size() - INDEX_DIGITS) + format_index(index);
+    }
 };
 
 
@@ -119,14 +147,7 @@ class PedestrianRoad : public PedroRoad {
 
     virtual string get_id(int index, Way& way) {
         string id = to_string(way.id());
-        id += pad_zeroes(index, 2);
-        return id;
-    }
-
-    virtual string get_id(int index, string old_id) {
-        int len_old = old_id.length();
-        string id = old_id.substr(0, len_old - 3);
-        id += pad_zeroes(index, 2);
+        id += format_index(index);
         return id;
     }
     
@@ -146,23 +167,27 @@ public:
         osm_id = to_string(way.id());
     }
 
-    PedestrianRoad(int index, PedestrianRoad* road, Geometry* geometry) {
-        this->id = get_id(index, road->id);
+    /***
+     * Empty road, the members are filled by the Checkpoint.
+     */
+    PedestrianRoad() {
+    }
+
+    /***
+     * Piece of a split road. If the length is not given, it is calculated.
+     */
+    PedestrianRoad(int index, PedestrianRoad* road, Geometry* geometry,
+            double length = -1) {
+        this->id = road->with_index(index);
         this->name = road->name;
         this->type = road->type;
         this->geometry = geometry;
-        this->length = go.get_length(geometry);
+        this->length = (length < 0) ? go.get_length(geometry) : length;
         this->osm_id = road->osm_id;
     }
 
     virtual ~PedestrianRoad() {
     }
-    
-    int get_index() {
-        int len = id.length();
-        int index = stoi(id.substr(len - 3, 2));
-        return index;
-    }
 };
 
 
@@ -180,6 +205,9 @@ public:
     int lanes;
     char sidewalk;
 
+    VehicleRoad() {
+    }
+
     VehicleRoad(int index, Way& way) {
         this->id = get_id(index, way);
         init_road(id, way);
@@ -201,29 +229,18 @@ class Sidewalk : public PedroRoad {
         id += pad_zeroes(sid.from, 6);
         id += pad_zeroes(sid.to, 6);
         id += (sid.left) ? "0" : "1";
-        id += pad_zeroes(sid.index, 2);
+        id += format_index(sid.index);
         return id;
     }
 
-    string increment_id(string origin_id) {
-        string new_id;
-        int index = stoi(origin_id.substr(13, 2));
-        index++;
-        new_id = change_index(origin_id, index);
-        return new_id;
-    }
-
-    string change_index(string origin_id, int index) {
-        string new_id;
-        new_id = origin_id.substr(0, 13) + pad_zeroes(index, 2);
-        return new_id;
-    }
-
 public:
 
     string osm_id;
     string at_osm_type;
 
+    Sidewalk() {
+    }
+
     Sidewalk(SidewalkID sid, string name, Geometry* geometry,
             string type, string at_osm_type, double length) {
 
@@ -240,27 +257,28 @@ public:
         //this->osm_id = osm_id;
     }
 
-    Sidewalk(SidewalkID sid, Geometry* geometry, VehicleRoad* vehicle_road) {
+    Sidewalk(SidewalkID sid, Geometry* geometry, VehicleRoad* vehicle_road,
+            double length = -1) {
         this->id = get_id(sid);
         this->name = vehicle_road->name;
         this->geometry = geometry;
         this->type = "sidewalk";
         this->at_osm_type = vehicle_road->type;
-        this->length = go.get_length(geometry);
+        this->length = (length < 0) ? go.get_length(geometry) : length;
         this->osm_id = vehicle_road->osm_id;
     }        
 
-    Sidewalk(Sidewalk* origin_sidewalk, Geometry* geometry, int new_id = -1) {
+    Sidewalk(Sidewalk* origin_sidewalk, Geometry* geometry, int new_id = -1,
+            double length = -1) {
         if (new_id == -1) {
-            this->id = increment_id(origin_sidewalk->id);
-        } else {
-            this->id = change_index(origin_sidewalk->id, new_id);
+            new_id = origin_sidewalk->get_index() + 1;
         }
+        this->id = origin_sidewalk->with_index(new_id);
         this->name = origin_sidewalk->name;
         this->geometry = geometry;
         this->type = origin_sidewalk->type;
         this->at_osm_type = origin_sidewalk->at_osm_type;
-        this->length = go.get_length(geometry);
+        this->length = (length < 0) ? go.get_length(geometry) : length;
         this->osm_id = origin_sidewalk->osm_id;
     }
 
@@ -270,14 +288,9 @@ public:
     string get_neighbour_id() {
         char this_side = id.at(12);
         const string other_side = (this_side == '0') ? "1" : "0";
-        string neighbour_id = id.substr(0, 12) + other_side + id.substr(13, 2);
+        string neighbour_id = id.substr(0, 12) + other_side + id.substr(13);
         return neighbour_id;
     }
-
-    int get_index() {
-        int index = stoi(id.substr(13, 2));
-        return index;
-    }
 };
 
 
@@ -285,32 +298,22 @@ class Crossing : public PedroRoad {
 
     virtual string get_id(CrossingID cid) {
         string id = "";
-        id += cid.sidewalk_id.substr(0, cid.sidewalk_id.size() - 3);
+        id += cid.sidewalk_id.substr(0,
+                cid.sidewalk_id.size() - INDEX_DIGITS);
         id += (cid.osm_crossing) ? "2" : "3";
-        id += pad_zeroes(cid.index, 2);
+        id += format_index(cid.index);
         return id;
     }
 
-    string increment_id(string origin_id) {
-        string new_id;
-        int index = stoi(origin_id.substr(13, 2));
-        index++;
-        new_id = change_index(origin_id, index);
-        return new_id;
-    }
-
-    string change_index(string origin_id, int index) {
-        string new_id;
-        new_id = origin_id.substr(0, 13) + pad_zeroes(index, 2);
-        return new_id;
-    }
-
 public:
     
     //string osm_id;
     string osm_type;
     //string at_osm_type;
 
+    Crossing() {
+    }
+
     Crossing(CrossingID cid, string name, Geometry* geometry,
             string type, string osm_type, double length) {
 
@@ -328,28 +331,23 @@ public:
         //this->osm_id = osm_id;
     }
 
-    Crossing(Crossing* origin_crossing, Geometry* geometry, int new_id = -1) {
+    Crossing(Crossing* origin_crossing, Geometry* geometry, int new_id = -1,
+            double length = -1) {
         if (new_id == -1) {
-            this->id = increment_id(origin_crossing->id);
-        } else {
-            this->id = change_index(origin_crossing->id, new_id);
+            new_id = origin_crossing->get_index() + 1;
         }
+        this->id = origin_crossing->with_index(new_id);
         this->name = origin_crossing->name;
         this->geometry = geometry;
         this->type = origin_crossing->type;
         //this->at_osm_type = origin_crossing->at_osm_type;
-        this->length = go.get_length(geometry);
+        this->length = (length < 0) ? go.get_length(geometry) : length;
         //this->osm_id = origin_crossing->osm_id;
         this->osm_type = origin_crossing->osm_type;
     }
 
     virtual ~Crossing() {
     }
-    
-    int get_index() {
-        int index = stoi(id.substr(13, 2));
-        return index;
-    }
 };
 
 #endif /* ROAD_HPP_ */
@@ -0,0 +1,153 @@
+/***
+ * run_file.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nathanael
+ *
+ *  Disk backed sorting of fixed size records. The records are collected in
+ *  a memory buffer. If the buffer reaches the memory budget it is sorted and
+ *  spilled as a run file into a temporary file. At the end all runs are
+ *  merged, so the records can be read in sorted order with bounded memory.
+ *  Used for the node/way pairs of the first pass (-m).
+ *
+ */
+
+#ifndef RUN_FILE_HPP_
+#define RUN_FILE_HPP_
+
+#include <stdio.h>
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <vector>
+
+template <typename TRecord>
+class RunFile {
+
+    /***
+     * One sorted run on disk. Reading is done in blocks of read_size.
+     */
+    struct Run {
+        FILE* file;
+        vector<TRecord> block;
+        size_t position;
+
+        explicit Run(FILE* file) :
+                file(file),
+                position(0) {
+        }
+
+        bool fill(size_t read_size) {
+            block.resize(read_size);
+            size_t count = fread(block.data(), sizeof(TRecord), read_size,
+                    file);
+            block.resize(count);
+            position = 0;
+            return count > 0;
+        }
+    };
+
+    typedef pair<TRecord, size_t> merge_entry_type;
+
+    struct MergeCompare {
+        bool operator()(const merge_entry_type& a,
+                const merge_entry_type& b) const {
+            return b.first < a.first;
+        }
+    };
+
+    vector<TRecord> buffer;
+    vector<FILE*> run_files;
+    size_t max_records;
+
+    /***
+     * Sort the buffer and write it as a new run.
+     */
+    void spill() {
+        if (buffer.empty()) {
+            return;
+        }
+        sort(buffer.begin(), buffer.end());
+        FILE* run_file = tmpfile();
+        if (!run_file) {
+            cerr << "Failed to create run file." << endl;
+            exit(1);
+        }
+        if (fwrite(buffer.data(), sizeof(TRecord), buffer.size(), run_file)
+                != buffer.size()) {
+            cerr << "Failed to write run file." << endl;
+            exit(1);
+        }
+        rewind(run_file);
+        run_files.push_back(run_file);
+        buffer.clear();
+    }
+
+public:
+
+    /***
+     * memory_budget is given in bytes and limits the buffer of unsorted
+     * records. The buffer is released before the merge, whose blocks share
+     * the same budget.
+     */
+    explicit RunFile(size_t memory_budget) {
+        max_records = max(memory_budget / sizeof(TRecord),
+                static_cast<size_t>(1024));
+        buffer.reserve(max_records);
+    }
+
+    ~RunFile() {
+        for (FILE* run_file : run_files) {
+            fclose(run_file);
+        }
+    }
+
+    void add(const TRecord& record) {
+        buffer.push_back(record);
+        if (buffer.size() >= max_records) {
+            spill();
+        }
+    }
+
+    /***
+     * Merge all runs and call the visitor for each record in sorted order.
+     * If nothing was spilled the buffer is sorted in memory.
+     */
+    void for_each_sorted(function<void(const TRecord&)> visitor) {
+        if (run_files.empty()) {
+            sort(buffer.begin(), buffer.end());
+            for (const TRecord& record : buffer) {
+                visitor(record);
+            }
+            return;
+        }
+        spill();
+        vector<TRecord>().swap(buffer);
+        size_t read_size = max(max_records / run_files.size(),
+                static_cast<size_t>(256));
+        vector<Run> runs;
+        for (FILE* run_file : run_files) {
+            runs.push_back(Run(run_file));
+        }
+        priority_queue<merge_entry_type, vector<merge_entry_type>,
+                MergeCompare> heap;
+        for (size_t i = 0; i < runs.size(); ++i) {
+            if (runs[i].fill(read_size)) {
+                heap.push(merge_entry_type(runs[i].block[0], i));
+            }
+        }
+        while (!heap.empty()) {
+            merge_entry_type top = heap.top();
+            heap.pop();
+            visitor(top.first);
+            Run& run = runs[top.second];
+            run.position++;
+            if ((run.position < run.block.size()) || run.fill(read_size)) {
+                heap.push(merge_entry_type(run.block[run.position],
+                        top.second));
+            }
+        }
+    }
+};
+
+#endif /* RUN_FILE_HPP_ */
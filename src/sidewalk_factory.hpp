@@ -5,7 +5,9 @@
  *      Author: nathanael
  *  
  *  The SidewalkFactory creates the sidewalks for every VehicleRoad
- *  connection stored in the vehicle_node_map.
+ *  connection stored in the vehicle_node_map. In the chain mode the
+ *  connections over chain nodes (see GeometryConstructor) are contracted
+ *  and one sidewalk per side is created for the whole chain.
  *
  */
 
@@ -13,6 +15,16 @@
 #ifndef SIDEWALK_FACTORY_HPP_
 #define SIDEWALK_FACTORY_HPP_
 
+/***
+ * Sidewalk without geometry, the parallel line between the two nodes is
+ * constructed later (parallel sidewalk generation).
+ */
+struct DeferredSegment {
+    Sidewalk* sidewalk;
+    vector<object_id_type> chain;
+    bool left;
+};
+
 class SidewalkFactory {
 
     DataStorage& ds;
@@ -21,6 +33,10 @@ class SidewalkFactory {
     GeometryFactory geos_factory;
     const bool left = true;
     const bool right = false;
+    const double offset = Parameters::get().sidewalk_offset;
+    vector<DeferredSegment>* deferred_segments;
+    const google::sparse_hash_set<object_id_type>* chain_nodes;
+    vector<Coordinate> intersection_points;   // of intersection
 
     /***
      * Concatenating two OSM ID to identicate a connection.
@@ -58,25 +74,39 @@ class SidewalkFactory {
     }
 
     /***
-     * Test if sidewalk segment is on th covex side of the curve using the
-     * angle. Because of the precision of double, excact 180 degrees are
-     * hardly possible.
+     * Test if sidewalk segment is on th covex side of the curve, that is the
+     * second segment turns counterclockwise. Because of the precision of
+     * double, excact 180 degrees are hardly possible.
      *
      */
     bool is_convex(LineString* segment1, LineString* segment2,
             bool reverse_first, bool reverse_second) {
 
-        LineString* from = nullptr;
-        LineString* to = nullptr;
-        from = (reverse_first ? dynamic_cast<LineString*>(segment1->reverse())
-                : segment1),
-        to = (reverse_second ? dynamic_cast<LineString*>(segment2->reverse())
-                : segment2);
-        double angle = go.angle(from, to);
-        if (angle > 180) {
-            return true;
+        Coordinate from = go.direction(segment1, reverse_first);
+        Coordinate to = go.direction(segment2, reverse_second);
+        return go.cross_product(from, to) > 0;
+    }
+
+    /***
+     * Intersection of two sidewalk segments, see
+     * GeomOperate::line_intersections. The segments may belong to another
+     * worker, so no GEOS geometry is created or operated on. Like the
+     * intersection of GEOS it is a point_intersection only for one single
+     * point, which is written to coord. Several points or overlapping
+     * segments give collinear_intersection.
+     */
+    int intersection(const LineString* segment1, const LineString* segment2,
+            Coordinate& coord) {
+
+        if (!go.line_intersections(segment1, segment2, intersection_points)
+                || (intersection_points.size() > 1)) {
+            return collinear_intersection;
         }
-        return false;
+        if (intersection_points.empty()) {
+            return no_intersection;
+        }
+        coord = intersection_points[0];
+        return point_intersection;
     }
 
     /***
@@ -110,6 +140,7 @@ class SidewalkFactory {
      */
     Sidewalk *construct_parallel_sidewalk(int i, object_id_type node_id,
             vector<VehicleMapValue> neighbours,
+            const vector<object_id_type>& chain,
             vector<bool>& reverse,
             bool left) {
 
@@ -120,10 +151,16 @@ class SidewalkFactory {
         Sidewalk* sidewalk = nullptr;
         string connection = get_connection_string(current_id, neighbour_id);
         if (!is_constructed(connection)) {
-            segment = construct_segment(current_id, neighbour_id, left);
             SidewalkID sid(neighbours[i].from, 
                     neighbours[i].to, left, 1);
-            sidewalk = new Sidewalk(sid, segment, vehicle_road);
+            if (deferred_segments) {
+                sidewalk = new Sidewalk(sid, nullptr, vehicle_road, 0);
+                DeferredSegment deferred = {sidewalk, chain, left};
+                deferred_segments->push_back(deferred);
+            } else {
+                segment = construct_segment(chain, left);
+                sidewalk = new Sidewalk(sid, segment, vehicle_road);
+            }
             ds.sidewalk_map[sidewalk->id] = sidewalk;
             reverse.push_back(false);
         } else {
@@ -138,21 +175,56 @@ class SidewalkFactory {
     }
 
     /***
-     * Construct LineString parallel to two OSM locations.
+     * Construct LineString parallel to two OSM locations, or parallel to
+     * the locations of a chain.
      */
-    LineString* construct_segment(object_id_type current_id,
-            object_id_type neighbour_id, bool left) {
+    LineString* construct_segment(const vector<object_id_type>& chain,
+            bool left) {
 
+        if (chain.size() > 2) {
+            vector<Location> locations;
+            locations.reserve(chain.size());
+            for (object_id_type node_id : chain) {
+                locations.push_back(location_handler.get_node_location(
+                        node_id));
+            }
+            return go.parallel_polyline(locations, offset, left);
+        }
         Location current_location;
         Location neighbour_location;
-        current_location = location_handler.get_node_location(current_id);
-        neighbour_location = location_handler.get_node_location(neighbour_id);
+        current_location = location_handler.get_node_location(chain[0]);
+        neighbour_location = location_handler.get_node_location(chain[1]);
         LineString *segment = nullptr;
         segment = go.parallel_line(current_location, neighbour_location,
-                0.0045, left);
+                offset, left);
         return segment;
     }
 
+    /***
+     * Nodes from node_id over neighbour_id up to the first node, that is
+     * no chain node. Without chain nodes it is the single connection.
+     */
+    vector<object_id_type> get_chain(object_id_type node_id,
+            object_id_type neighbour_id) {
+
+        vector<object_id_type> chain = {node_id, neighbour_id};
+        if (!chain_nodes) {
+            return chain;
+        }
+        while ((chain.back() != node_id) &&
+                (chain_nodes->find(chain.back()) != chain_nodes->end())) {
+            const vector<VehicleMapValue>& neighbours =
+                    ds.vehicle_node_map.find(chain.back())->second;
+            object_id_type previous = chain[chain.size() - 2];
+            if (neighbours[0].node_id == previous) {
+                chain.push_back(neighbours[1].node_id);
+            } else {
+                chain.push_back(neighbours[0].node_id);
+            }
+        }
+        return chain;
+    }
+
     /***
      * Created tho connection between two sidewalk segments.
      * There are 3 cases:
@@ -170,31 +242,42 @@ class SidewalkFactory {
 
         LineString* segment1 = dynamic_cast<LineString*>(sidewalk1->geometry);
         LineString* segment2 = dynamic_cast<LineString*>(sidewalk2->geometry);
-        if (is_convex(segment1, segment2, reverse_first,
-                reverse_second)) {
-            Point* connector;
-            if (reverse_second) {
-                connector = segment2->getEndPoint();
-            } else {
-                connector = segment2->getStartPoint();
-            }
+        /* chains are joined by their segments at this node */
+        LineString* join1 = segment1;
+        LineString* join2 = segment2;
+        bool join_reverse_first = reverse_first;
+        bool join_reverse_second = reverse_second;
+        if (chain_nodes) {
+            join1 = go.end_segment(segment1, reverse_first);
+            join2 = go.end_segment(segment2, reverse_second);
+            join_reverse_first = false;
+            join_reverse_second = false;
+        }
+        Coordinate intersector;
+        int intersection_result = no_intersection;
+        if (is_convex(join1, join2, join_reverse_first,
+                join_reverse_second)) {
+            Coordinate connector = go.end_coordinate(segment2,
+                    reverse_second);
             segment1 = go.insert_point(segment1, connector, reverse_first);
-        } else if (segment1->intersects(segment2)) {
-            Geometry* intersector;
-            intersector = segment1->intersection(segment2);
-            if (intersector->getGeometryType() == "Point") {
-                segment1 = go.set_point(segment1, intersector, reverse_first);   
-                segment2 = go.set_point(segment2, intersector, reverse_second);
+        } else if ((intersection_result = intersection(join1, join2,
+                intersector)) != no_intersection) {
+            if (intersection_result == point_intersection) {
+                segment1 = go.set_point(segment1, intersector, reverse_first);
+                segment2 = go.set_point(segment2, intersector,
+                        reverse_second);
             }
         } else {
-            Point* mean;
-            mean = ((reverse_first ? segment1->getEndPoint() :
-                    segment1->getStartPoint()),
-                    (reverse_second ? segment2->getEndPoint() :
-                    segment2->getStartPoint()));
+            /* the former (start, end) expression evaluated to the end of
+             * the second segment, this is kept */
+            Coordinate mean = go.end_coordinate(segment2, reverse_second);
             segment1 = go.set_point(segment1, mean, reverse_first);
             segment2 = go.set_point(segment2, mean, reverse_second);
         }
+        if (chain_nodes) {
+            geos_factory.destroyGeometry(join1);
+            geos_factory.destroyGeometry(join2);
+        }
         sidewalk1->geometry = segment1;
         sidewalk2->geometry = segment2;
     }
@@ -208,13 +291,8 @@ class SidewalkFactory {
     
         LineString* segment1 = dynamic_cast<LineString*>(sidewalk1->geometry);
         LineString* segment2 = dynamic_cast<LineString*>(sidewalk2->geometry);
-        Point* connector;
-        if (reverse_second) {
-            connector = segment2->getEndPoint();
-        } else {
-            connector = segment2->getStartPoint();
-        }
-        segment1 = go.insert_point(segment1, connector, (reverse_first ? 2 : 0));
+        Coordinate connector = go.end_coordinate(segment2, reverse_second);
+        segment1 = go.insert_point(segment1, connector, reverse_first);
         sidewalk1->geometry = segment1;
     }
     
@@ -224,7 +302,44 @@ public:
 
     explicit SidewalkFactory(DataStorage& data_storage,
             location_handler_type& location_handler) :
-            ds(data_storage), location_handler(location_handler) {
+            ds(data_storage), location_handler(location_handler),
+            deferred_segments(nullptr),
+            chain_nodes(nullptr) {
+    }
+
+    /***
+     * Create the geometries with the given factory, which has to outlive
+     * them, see DataStorage::get_worker_factory.
+     */
+    void set_factory(const GeometryFactory* factory) {
+        go.set_factory(factory);
+    }
+
+    /***
+     * Switch to the chain mode, nodes is the set of chain nodes.
+     */
+    void set_chain_nodes(const google::sparse_hash_set<object_id_type>*
+            nodes) {
+        chain_nodes = nodes;
+    }
+
+    /***
+     * If set, new sidewalks are created without geometry and stored in
+     * deferred, see construct_deferred_segment.
+     */
+    void set_deferred_segments(vector<DeferredSegment>* deferred) {
+        deferred_segments = deferred;
+    }
+
+    /***
+     * Construct the geometry of a deferred sidewalk. The length is the
+     * length of the parallel line, as for a sidewalk constructed at once.
+     */
+    void construct_deferred_segment(const DeferredSegment& deferred) {
+        LineString* segment = construct_segment(deferred.chain,
+                deferred.left);
+        deferred.sidewalk->geometry = segment;
+        deferred.sidewalk->length = go.get_length(segment);
     }
 
     /***
@@ -239,11 +354,12 @@ public:
         for (int i = 0; i < count_neighbours; ++i) {
             object_id_type neighbour_id = neighbours[i].node_id;
             string connection = get_connection_string(node_id, neighbour_id);
+            vector<object_id_type> chain = get_chain(node_id, neighbour_id);
             Sidewalk* left_sidewalk = nullptr;
             Sidewalk* right_sidewalk = nullptr;
             if (sidewalk_exists(neighbours[i], left)) {
                 left_sidewalk = construct_parallel_sidewalk(i, node_id,
-                        neighbours, reverse, left);
+                        neighbours, chain, reverse, left);
                 //left_sidewalk = construct_parallel_sidewalk(i, count_neighbours,
                         //node_id, neighbours, reverse, left);
             } else {
@@ -251,7 +367,7 @@ public:
             }
             if (sidewalk_exists(neighbours[i], right)) {
                 right_sidewalk = construct_parallel_sidewalk(i, node_id,
-                        neighbours, reverse, right);
+                        neighbours, chain, reverse, right);
                 //right_sidewalk = construct_parallel_sidewalk(i, count_neighbours,
                         //node_id, neighbours, reverse, right);
             } else {
@@ -260,6 +376,12 @@ public:
             segments.push_back(left_sidewalk);
             segments.push_back(right_sidewalk);
             insert_segments(connection, left_sidewalk, right_sidewalk);
+            /* the node at the other end of the chain finds it as well */
+            if (chain.size() > 2) {
+                insert_segments(get_connection_string(chain.back(),
+                        chain[chain.size() - 2]), left_sidewalk,
+                        right_sidewalk);
+            }
         }
     }
                 
@@ -0,0 +1,101 @@
+/***
+ * simd_double.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nathanael
+ *
+ *  Packed doubles for the batch kernels of GeomOperate. With AVX (e.g.
+ *  -mavx2 or -march=native) a SimdDouble has 4 lanes, with SSE2 (default
+ *  of x86-64) 2 lanes. Otherwise or with -DPEDRO_NO_SIMD the width is 0
+ *  and the batch functions only use their scalar loops.
+ *
+ */
+
+#ifndef SIMD_DOUBLE_HPP_
+#define SIMD_DOUBLE_HPP_
+
+#if defined(__AVX__) && !defined(PEDRO_NO_SIMD)
+
+#include <immintrin.h>
+#define SIMD_DOUBLE_WIDTH 4
+
+struct SimdDouble {
+    __m256d value;
+
+    SimdDouble(__m256d v) : value(v) {
+    }
+
+    explicit SimdDouble(double d) : value(_mm256_set1_pd(d)) {
+    }
+
+    static SimdDouble load(const double* p) {
+        return _mm256_loadu_pd(p);
+    }
+
+    void store(double* p) const {
+        _mm256_storeu_pd(p, value);
+    }
+
+    SimdDouble sqrt() const {
+        return _mm256_sqrt_pd(value);
+    }
+};
+
+inline SimdDouble operator+(SimdDouble a, SimdDouble b) {
+    return _mm256_add_pd(a.value, b.value);
+}
+
+inline SimdDouble operator-(SimdDouble a, SimdDouble b) {
+    return _mm256_sub_pd(a.value, b.value);
+}
+
+inline SimdDouble operator*(SimdDouble a, SimdDouble b) {
+    return _mm256_mul_pd(a.value, b.value);
+}
+
+#elif defined(__SSE2__) && !defined(PEDRO_NO_SIMD)
+
+#include <emmintrin.h>
+#define SIMD_DOUBLE_WIDTH 2
+
+struct SimdDouble {
+    __m128d value;
+
+    SimdDouble(__m128d v) : value(v) {
+    }
+
+    explicit SimdDouble(double d) : value(_mm_set1_pd(d)) {
+    }
+
+    static SimdDouble load(const double* p) {
+        return _mm_loadu_pd(p);
+    }
+
+    void store(double* p) const {
+        _mm_storeu_pd(p, value);
+    }
+
+    SimdDouble sqrt() const {
+        return _mm_sqrt_pd(value);
+    }
+};
+
+inline SimdDouble operator+(SimdDouble a, SimdDouble b) {
+    return _mm_add_pd(a.value, b.value);
+}
+
+inline SimdDouble operator-(SimdDouble a, SimdDouble b) {
+    return _mm_sub_pd(a.value, b.value);
+}
+
+inline SimdDouble operator*(SimdDouble a, SimdDouble b) {
+    return _mm_mul_pd(a.value, b.value);
+}
+
+#else
+
+#define SIMD_DOUBLE_WIDTH 0
+
+#endif
+
+#endif /* SIMD_DOUBLE_HPP_ */
@@ -0,0 +1,258 @@
+/***
+ * snap_grid.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nathanael
+ *
+ *  Many OSM footways end just in front of the constructed sidewalks or
+ *  crossings, so they are never connected. The SnapGrid hashes all
+ *  sidewalk and crossing segments into a uniform grid with the size of
+ *  the snap tolerance. Every dangling footway end looks up the
+ *  neighbouring cells only and is moved onto the closest segment.
+ *  Replaces the unused GeomOperate::enlarge_line.
+ *
+ */
+
+#ifndef SNAP_GRID_HPP_
+#define SNAP_GRID_HPP_
+
+#include <limits>
+
+class SnapGrid {
+
+    DataStorage& ds;
+    GeomOperate go;
+    GeometryFactory geos_factory;
+    google::sparse_hash_map<uint64_t, vector<LineSegment>> grid;
+    google::sparse_hash_map<uint64_t, int> endpoint_count;
+    double cell_size;
+
+    //PARAMETERS
+    const double snap_tolerance = 0.003;  // maximal distance of a footway
+                                          // end to a sidewalk in km
+    const double overshoot = 0.0000001;   // the snapped end is moved this
+                                          // far (degrees) beyond the
+                                          // sidewalk to intersect it
+
+    int64_t cell_index(double value) {
+        return static_cast<int64_t>(floor(value / cell_size));
+    }
+
+    uint64_t cell_key(int64_t x, int64_t y) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) |
+                static_cast<uint32_t>(y);
+    }
+
+    /***
+     * Key of the exact coordinate to count the footway ends.
+     */
+    uint64_t coordinate_key(const Coordinate& coord) {
+        Location location(coord.x, coord.y);
+        return go.spatial_key(location);
+    }
+
+    /***
+     * Insert the segment into every cell it crosses (supercover): the walk
+     * steps to the next cell over the closer vertical or horizontal grid
+     * line. Through a corner it steps diagonally and also takes the two
+     * cells beside the corner.
+     */
+    void insert_segment(const Coordinate& start, const Coordinate& end) {
+        LineSegment segment(start, end);
+        double x0 = start.x / cell_size;
+        double y0 = start.y / cell_size;
+        double dx = abs(end.x / cell_size - x0);
+        double dy = abs(end.y / cell_size - y0);
+        int64_t x = cell_index(start.x);
+        int64_t y = cell_index(start.y);
+        int64_t end_x = cell_index(end.x);
+        int64_t end_y = cell_index(end.y);
+        int64_t step_x = (end_x > x) ? 1 : -1;
+        int64_t step_y = (end_y > y) ? 1 : -1;
+        // position (0..1) along the segment of the next grid lines
+        const double never = numeric_limits<double>::infinity();
+        double next_x = (dx == 0) ? never :
+                ((step_x > 0) ? (x + 1 - x0) : (x0 - x)) / dx;
+        double next_y = (dy == 0) ? never :
+                ((step_y > 0) ? (y + 1 - y0) : (y0 - y)) / dy;
+        double delta_x = (dx == 0) ? never : 1 / dx;
+        double delta_y = (dy == 0) ? never : 1 / dy;
+        int64_t remaining_x = abs(end_x - x);
+        int64_t remaining_y = abs(end_y - y);
+        grid[cell_key(x, y)].push_back(segment);
+        while ((remaining_x > 0) || (remaining_y > 0)) {
+            if ((remaining_x > 0) && (remaining_y > 0) &&
+                    (next_x == next_y)) {
+                grid[cell_key(x + step_x, y)].push_back(segment);
+                grid[cell_key(x, y + step_y)].push_back(segment);
+                x += step_x;
+                y += step_y;
+                next_x += delta_x;
+                next_y += delta_y;
+                remaining_x--;
+                remaining_y--;
+            } else if ((remaining_y == 0) ||
+                    ((remaining_x > 0) && (next_x < next_y))) {
+                x += step_x;
+                next_x += delta_x;
+                remaining_x--;
+            } else {
+                y += step_y;
+                next_y += delta_y;
+                remaining_y--;
+            }
+            grid[cell_key(x, y)].push_back(segment);
+        }
+    }
+
+    void insert_geometry(Geometry* geometry) {
+        const CoordinateSequence* coords =
+                dynamic_cast<LineString*>(geometry)->getCoordinatesRO();
+        for (size_t i = 0; i + 1 < coords->getSize(); ++i) {
+            insert_segment(coords->getAt(i), coords->getAt(i + 1));
+        }
+    }
+
+    /***
+     * Find the closest point on a sidewalk or crossing segment in the cell
+     * of the point and the 8 neighbours. Returns false if there is none
+     * within the tolerance or the point is already on a segment.
+     */
+    bool find_snap_point(const Coordinate& point, Coordinate& snap_point) {
+        int64_t x = cell_index(point.x);
+        int64_t y = cell_index(point.y);
+        double min_distance = snap_tolerance;
+        bool found = false;
+        for (int64_t dx = -1; dx <= 1; ++dx) {
+            for (int64_t dy = -1; dy <= 1; ++dy) {
+                auto cell = grid.find(cell_key(x + dx, y + dy));
+                if (cell == grid.end()) {
+                    continue;
+                }
+                for (const LineSegment& segment : cell->second) {
+                    Coordinate closest;
+                    segment.closestPoint(point, closest);
+                    double distance = go.haversine(point, closest);
+                    if (distance == 0) {
+                        return false;
+                    }
+                    if (distance < min_distance) {
+                        min_distance = distance;
+                        snap_point = closest;
+                        found = true;
+                    }
+                }
+            }
+        }
+        return found;
+    }
+
+    /***
+     * Move the end (at_end) or the start of a footway onto the closest
+     * segment and a bit beyond, so the connection stage finds the
+     * intersection.
+     */
+    bool snap_end(PedestrianRoad* pedestrian, bool at_end) {
+        LineString* linestring = dynamic_cast<LineString*>(
+                pedestrian->geometry);
+        size_t num_points = linestring->getNumPoints();
+        size_t end_index = at_end ? num_points - 1 : 0;
+        size_t inner_index = at_end ? num_points - 2 : 1;
+        const Coordinate& end = linestring->getCoordinateN(end_index);
+        const Coordinate& inner = linestring->getCoordinateN(inner_index);
+        if (endpoint_count[coordinate_key(end)] > 1) {
+            return false;
+        }
+        Coordinate snap_point;
+        if (!find_snap_point(end, snap_point)) {
+            return false;
+        }
+        double dx = snap_point.x - inner.x;
+        double dy = snap_point.y - inner.y;
+        double length = sqrt(dx * dx + dy * dy);
+        if (length == 0) {
+            return false;
+        }
+        snap_point.x += dx / length * overshoot;
+        snap_point.y += dy / length * overshoot;
+        CoordinateSequence* coords = linestring->getCoordinates();
+        coords->setAt(snap_point, end_index);
+        pedestrian->geometry = geos_factory.createLineString(coords);
+        geos_factory.destroyGeometry(linestring);
+        return true;
+    }
+
+public:
+
+    explicit SnapGrid(DataStorage& data_storage) :
+            ds(data_storage),
+            cell_size(0) {
+    }
+
+    /***
+     * Hash all sidewalks and crossings into the grid. The cell size is the
+     * snap tolerance in degrees of longitude (the larger one) at the
+     * largest absolute latitude of the extract, so the cells are at least
+     * as large as the tolerance everywhere.
+     */
+    void fill_grid() {
+        double max_abs_lat = -1;
+        for (auto map_entry : ds.sidewalk_map) {
+            const Envelope* envelope =
+                    map_entry.second->geometry->getEnvelopeInternal();
+            max_abs_lat = max(max_abs_lat, max(abs(envelope->getMinY()),
+                    abs(envelope->getMaxY())));
+        }
+        if (max_abs_lat < 0) {
+            return;
+        }
+        for (Crossing* crossing : ds.crossing_set) {
+            const Envelope* envelope =
+                    crossing->geometry->getEnvelopeInternal();
+            max_abs_lat = max(max_abs_lat, max(abs(envelope->getMinY()),
+                    abs(envelope->getMaxY())));
+        }
+        cell_size = go.inverse_haversine(max_abs_lat, snap_tolerance).lon;
+        for (auto map_entry : ds.sidewalk_map) {
+            insert_geometry(map_entry.second->geometry);
+        }
+        for (Crossing* crossing : ds.crossing_set) {
+            insert_geometry(crossing->geometry);
+        }
+    }
+
+    /***
+     * Snap all dangling footway ends. An end is dangling, if no other
+     * pedestrian road ends at the same coordinate.
+     * Returns the number of snapped footways.
+     */
+    int snap_pedestrians() {
+        fill_grid();
+        if (cell_size == 0) {
+            return 0;
+        }
+        for (PedestrianRoad* pedestrian : ds.pedestrian_road_set) {
+            LineString* linestring = dynamic_cast<LineString*>(
+                    pedestrian->geometry);
+            endpoint_count[coordinate_key(
+                    linestring->getCoordinateN(0))]++;
+            endpoint_count[coordinate_key(linestring->getCoordinateN(
+                    linestring->getNumPoints() - 1))]++;
+        }
+        int count_snapped = 0;
+        for (PedestrianRoad* pedestrian : ds.pedestrian_road_set) {
+            if (pedestrian->geometry->getNumPoints() < 2) {
+                continue;
+            }
+            bool snapped = snap_end(pedestrian, false);
+            snapped = snap_end(pedestrian, true) || snapped;
+            if (snapped) {
+                pedestrian->length = go.get_length(pedestrian->geometry);
+                count_snapped++;
+            }
+        }
+        return count_snapped;
+    }
+};
+
+#endif /* SNAP_GRID_HPP_ */
@@ -0,0 +1,140 @@
+/***
+ * spatial_join.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nathanael
+ *
+ *  Batched spatial join of two collections of envelopes. Both collections
+ *  are bulk loaded into a PackedRTree and both trees are traversed
+ *  together, only node pairs with intersecting boxes are expanded. All
+ *  overlapping pairs are returned at once instead of one tree query per
+ *  item. The traversal is split into independent node pairs, which are
+ *  distributed across threads, the result does not depend on the number
+ *  of threads.
+ *
+ */
+
+#ifndef SPATIAL_JOIN_HPP_
+#define SPATIAL_JOIN_HPP_
+
+#include <algorithm>
+#include <thread>
+#include <geos/geom/Envelope.h>
+
+typedef pair<size_t, size_t> join_pair_type;
+
+class SpatialJoin {
+
+public:
+
+    /* tree of envelope positions, e.g. to reuse the right side */
+    typedef PackedRTree<size_t> tree_type;
+
+private:
+
+    typedef tree_type::node_pair_type node_pair_type;
+
+    unsigned int num_threads;
+
+    //PARAMETERS
+    const size_t min_chunk_size = 4096;  // minimal number of left boxes
+                                         // per thread
+    const size_t tasks_per_thread = 16;  // node pairs per thread, for an
+                                         // even load
+
+    /***
+     * Join the node pairs first, first + step, ... of tasks.
+     */
+    static void join_tasks(const tree_type& left, const tree_type& right,
+            const vector<node_pair_type>& tasks, size_t first, size_t step,
+            vector<join_pair_type>& pairs) {
+
+        for (size_t i = first; i < tasks.size(); i += step) {
+            left.join_nodes(right, tasks[i], [&](size_t l, size_t r) {
+                pairs.push_back(join_pair_type(l, r));
+            });
+        }
+    }
+
+public:
+
+    explicit SpatialJoin(unsigned int num_threads = 1) :
+            num_threads(max(num_threads, 1u)) {
+    }
+
+    /***
+     * Tree of the positions of the envelopes, null envelopes are skipped.
+     */
+    static void fill_tree(const vector<const Envelope*>& envelopes,
+            tree_type& tree) {
+
+        for (size_t i = 0; i < envelopes.size(); ++i) {
+            if (!envelopes[i]->isNull()) {
+                tree.add(i, *envelopes[i]);
+            }
+        }
+        tree.finish();
+    }
+
+    /***
+     * Find all pairs of overlapping envelopes. The pairs hold the positions
+     * in left and right and are sorted by left, then by right. Null
+     * envelopes are skipped.
+     */
+    void join(const vector<const Envelope*>& left,
+            const vector<const Envelope*>& right,
+            vector<join_pair_type>& pairs) {
+
+        tree_type right_tree;
+        fill_tree(right, right_tree);
+        join(left, right_tree, pairs);
+    }
+
+    /***
+     * join with the finished tree of the right envelopes, see fill_tree.
+     */
+    void join(const vector<const Envelope*>& left,
+            const tree_type& right_tree, vector<join_pair_type>& pairs) {
+
+        pairs.clear();
+        tree_type left_tree;
+        fill_tree(left, left_tree);
+        size_t num_chunks = min(static_cast<size_t>(num_threads),
+                left_tree.size() / min_chunk_size + 1);
+        vector<node_pair_type> tasks = left_tree.split_join(right_tree,
+                num_chunks * tasks_per_thread);
+        if (num_chunks == 1) {
+            join_tasks(left_tree, right_tree, tasks, 0, 1, pairs);
+        } else {
+            vector<vector<join_pair_type>> chunk_pairs(num_chunks);
+            vector<thread> workers;
+            for (size_t i = 0; i < num_chunks; ++i) {
+                workers.push_back(thread(&SpatialJoin::join_tasks,
+                        cref(left_tree), cref(right_tree), cref(tasks), i,
+                        num_chunks, ref(chunk_pairs[i])));
+            }
+            for (size_t i = 0; i < num_chunks; ++i) {
+                workers[i].join();
+                pairs.insert(pairs.end(), chunk_pairs[i].begin(),
+                        chunk_pairs[i].end());
+            }
+        }
+        sort(pairs.begin(), pairs.end());
+    }
+
+    /***
+     * End of the pairs with the same left position as pairs[begin].
+     */
+    static size_t group_end(const vector<join_pair_type>& pairs,
+            size_t begin) {
+
+        size_t end = begin;
+        while ((end < pairs.size()) &&
+                (pairs[end].first == pairs[begin].first)) {
+            end++;
+        }
+        return end;
+    }
+};
+
+#endif /* SPATIAL_JOIN_HPP_ */
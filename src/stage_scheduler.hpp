@@ -0,0 +1,205 @@
+/***
+ * stage_scheduler.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nathanael
+ *
+ *  Small task graph for the stages of the pipeline. Each task declares the
+ *  parts of the DataStorage it reads and writes (e.g. "sidewalks",
+ *  "output"). A task depends on every earlier added task it conflicts
+ *  with: one of both writes a part the other one reads or writes. So the
+ *  result is the same as running the tasks one after the other in the
+ *  order they are added, but tasks without conflict run concurrently on
+ *  the worker pool. The run time of every task is measured.
+ *  The pool has num_threads workers and every running task takes one of
+ *  them. A parallel task gets all threads that are free when it starts,
+ *  so overlapping stages do not use more than num_threads threads.
+ *
+ */
+
+#ifndef STAGE_SCHEDULER_HPP_
+#define STAGE_SCHEDULER_HPP_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <thread>
+
+class StageScheduler {
+
+    struct Task {
+        string name;
+        vector<string> reads;
+        vector<string> writes;
+        function<void(unsigned int)> run;  // with the number of threads
+        bool parallel;
+        unsigned int num_threads;          // of the last run
+        vector<size_t> dependents;
+        size_t num_dependencies;
+        timer task_timer;
+    };
+
+    vector<Task> tasks;
+    unsigned int num_threads;
+
+    // state of run()
+    mutex task_mutex;
+    condition_variable task_ready;
+    set<size_t> ready_tasks;
+    size_t num_finished;
+    unsigned int busy_threads;          // of the running tasks
+
+    static bool shares_part(const vector<string>& parts1,
+            const vector<string>& parts2) {
+
+        for (const string& part : parts1) {
+            if (find(parts2.begin(), parts2.end(), part) != parts2.end()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool conflicts(const Task& task1, const Task& task2) {
+        return shares_part(task1.writes, task2.reads) ||
+                shares_part(task1.writes, task2.writes) ||
+                shares_part(task1.reads, task2.writes);
+    }
+
+    void add_task(string name, vector<string> reads, vector<string> writes,
+            function<void(unsigned int)> run, bool parallel) {
+
+        Task task;
+        task.name = name;
+        task.reads = reads;
+        task.writes = writes;
+        task.run = run;
+        task.parallel = parallel;
+        task.num_threads = 0;
+        task.num_dependencies = 0;
+        tasks.push_back(task);
+    }
+
+    /***
+     * Dependencies of each task on the earlier tasks.
+     */
+    void build_graph() {
+        for (size_t j = 0; j < tasks.size(); ++j) {
+            tasks[j].num_dependencies = 0;
+            tasks[j].dependents.clear();
+        }
+        for (size_t j = 0; j < tasks.size(); ++j) {
+            for (size_t i = 0; i < j; ++i) {
+                if (conflicts(tasks[i], tasks[j])) {
+                    tasks[i].dependents.push_back(j);
+                    tasks[j].num_dependencies++;
+                }
+            }
+        }
+    }
+
+    /***
+     * Worker loop, the ready task added first is started first, as soon as
+     * a thread is free.
+     */
+    void work() {
+        unique_lock<mutex> lock(task_mutex);
+        while (true) {
+            task_ready.wait(lock, [this] {
+                return (!ready_tasks.empty() &&
+                        (busy_threads < num_threads)) ||
+                        (num_finished == tasks.size());
+            });
+            if (num_finished == tasks.size()) {
+                return;
+            }
+            size_t position = *ready_tasks.begin();
+            ready_tasks.erase(ready_tasks.begin());
+            Task& task = tasks[position];
+            task.num_threads = task.parallel ? num_threads - busy_threads : 1;
+            busy_threads += task.num_threads;
+            lock.unlock();
+            task.task_timer.start();
+            task.run(task.num_threads);
+            task.task_timer.stop();
+            lock.lock();
+            busy_threads -= task.num_threads;
+            num_finished++;
+            for (size_t dependent : task.dependents) {
+                if (--tasks[dependent].num_dependencies == 0) {
+                    ready_tasks.insert(dependent);
+                }
+            }
+            task_ready.notify_all();
+        }
+    }
+
+public:
+
+    explicit StageScheduler(unsigned int num_threads = 1) :
+            num_threads(max(num_threads, 1u)),
+            num_finished(0),
+            busy_threads(0) {
+    }
+
+    /***
+     * Add a task, which reads and writes the given parts.
+     */
+    void add(string name, vector<string> reads, vector<string> writes,
+            function<void()> run) {
+
+        add_task(name, reads, writes, [run](unsigned int) {
+            run();
+        }, false);
+    }
+
+    /***
+     * Add a task with own worker threads, run is called with their number.
+     */
+    void add_parallel(string name, vector<string> reads,
+            vector<string> writes, function<void(unsigned int)> run) {
+
+        add_task(name, reads, writes, run, true);
+    }
+
+    /***
+     * Run all tasks and wait for them.
+     */
+    void run() {
+        build_graph();
+        ready_tasks.clear();
+        num_finished = 0;
+        busy_threads = 0;
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            if (tasks[i].num_dependencies == 0) {
+                ready_tasks.insert(i);
+            }
+        }
+        unsigned int num_workers = min(static_cast<size_t>(num_threads),
+                max(tasks.size(), static_cast<size_t>(1)));
+        vector<thread> workers;
+        for (unsigned int i = 1; i < num_workers; ++i) {
+            workers.push_back(thread(&StageScheduler::work, this));
+        }
+        work();
+        for (thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    /***
+     * Run time of every task, in the order they were added.
+     */
+    void print_timing(ostream& out) {
+        for (Task& task : tasks) {
+            out << "  " << task.name << ": " << task.task_timer;
+            if (task.parallel) {
+                out << " (" << task.num_threads << " threads)";
+            }
+            out << endl;
+        }
+    }
+};
+
+#endif /* STAGE_SCHEDULER_HPP_ */
@@ -52,42 +52,15 @@ public:
         return false;
     }
 
+    /***
+     * The highway types are taken from the current Profile.
+     */
     static bool is_vehicle(const osmium::OSMObject& osm_object) {
         if (is_polygon(osm_object)) {
             return false;
         }
         const char* highway = osm_object.get_value_by_key("highway");
-        /* ALL 
-        string type_list[] = {
-            "motorway", "trunk", "primary", "secondary", "tertiary",
-            "unclassified", "road", "residential", "service",        
-            "motorway_link", "trunk_link", "primary_link", "secondary_link",
-            "tertiary_link", "bus_guideway", "unclassified"
-        };
-        */
-        string type_list[] = {
-            // "motorway",
-            // "trunk",
-            "primary",
-            "secondary",
-            "tertiary",
-            "unclassified",
-            // "road",
-            "residential",
-            "service",        
-            // "motorway_link",
-            // "trunk_link",
-            "primary_link",
-            "secondary_link",
-            "tertiary_link",
-            "bus_guideway",
-            "unclassified"
-        };
-        vector<string> type_vector;
-        for (string item : type_list) {
-            type_vector.push_back(item);
-        }
-        return (char_in_list(highway, type_vector));
+        return Profile::get().is_vehicle_type(highway);
     }
 
     static bool is_pedestrian(const osmium::OSMObject& osm_object) {
@@ -95,29 +68,14 @@ public:
             return false;
         }
         const char* highway = osm_object.get_value_by_key("highway");
-        string type_list[] = {
-            "pedestrian",
-            "footway",
-            "steps",
-            "path",
-            "track",
-            "living_street"
-        };
-        vector<string> type_vector;
-        for (string item : type_list) {
-            type_vector.push_back(item);
-        }
-        if (char_in_list(highway, type_vector)) {
-            return true;
-        } else {
-            if (!strcmp(highway, "cycleway")) {
-                const char* foot = osm_object.get_value_by_key("foot");
-                if ((foot) && (!strcmp(foot, "yes"))) {
-                    return true;
-                }
-            }
+        if (!Profile::get().is_pedestrian_type(highway)) {
             return false;
         }
+        if (!strcmp(highway, "cycleway")) {
+            const char* foot = osm_object.get_value_by_key("foot");
+            return ((foot) && (!strcmp(foot, "yes")));
+        }
+        return true;
     }
 
     static bool is_tunnel(const osmium::OSMObject& osm_object) {
@@ -178,10 +136,14 @@ public:
         return osm_object.get_value_by_key("highway");
     }
 
+    /***
+     * Untagged roads get the default sidewalk of the current Profile.
+     */
     static char get_sidewalk_type(const osmium::OSMObject& osm_object) {
         const char* sidewalk = osm_object.get_value_by_key("sidewalk");
-        char sidewalk_chr = 'b';
+        char sidewalk_chr = Profile::get().default_sidewalk;
         if (sidewalk) {
+            sidewalk_chr = 'b';
             if ((!strcmp(sidewalk, "none")) || (!strcmp(sidewalk, "no"))) {
                 sidewalk_chr = 'n';
             } else if (!strcmp(sidewalk, "right")) {
@@ -213,24 +175,29 @@ public:
     }
 
     static string get_frequent_crossing_type(string osm_type/*, int lanes*/) {
-        string risk_list[] = {
-            "primary",
-            "primary_link",
-        };
-        vector<string> risk_vector;
-        for (string item : risk_list) {
-            risk_vector.push_back(item);
-        }
         /* NOT DONE: Sidewalks do not know their lanes.
         if ((lanes > 1) || (char_in_list("osm_type"))) {
             return "risk-crossing";
         }
         */
-        if (char_in_list(osm_type.c_str(), risk_vector)) {
+        if (Profile::get().is_risk_type(osm_type)) {
             return "risk-crossing";
         }
         return "frequent-crossing";
     }
+
+    /***
+     * Factor of the length for the cost of a way in the topology.
+     */
+    static double get_cost_factor(string type) {
+        if (type == "risk-crossing") {
+            return Parameters::get().risk_crossing_cost;
+        }
+        if (type == "frequent-crossing") {
+            return Parameters::get().frequent_crossing_cost;
+        }
+        return 1;
+    }
 };
 
 #endif /* TAGCHECK_HPP_ */
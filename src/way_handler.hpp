@@ -24,7 +24,6 @@ class WayHandler : public handler::Handler {
     DataStorage& ds;
     location_handler_type& location_handler;
     GeomOperate go;
-    Contrast contrast = Contrast(ds);
     const bool left = true;
     const bool right = false;
 
@@ -42,7 +41,6 @@ class WayHandler : public handler::Handler {
      * PedestrianRoad are created for each way segment between crossings.
      * Whether a node is a crossing is looked up in the pedestrian_node_map.
      * The PedestrianRoad is stored to pedestrian_road_set.
-     * The orthogonals for they contrast calculations are also created now.
      * TODO: some logical problems: e.g. at lindenmuseum crossing.
      */
     void handle_pedestrian_road(Way& way) {
@@ -65,7 +63,6 @@ class WayHandler : public handler::Handler {
                     first_node = current_node;
                     PedestrianRoad* pedestrian_road = new PedestrianRoad(0, way, linestring);
                     ds.pedestrian_road_set.insert(pedestrian_road);
-                    contrast.create_orthogonals(linestring);
                 }
                 last_node++;
             }
@@ -75,7 +72,6 @@ class WayHandler : public handler::Handler {
             PedestrianRoad* pedestrian_road = new PedestrianRoad(0, way,
                     linestring);
             ds.pedestrian_road_set.insert(pedestrian_road);
-            contrast.create_orthogonals(linestring);
         }
     }
 